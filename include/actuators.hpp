@@ -0,0 +1,85 @@
+#ifndef _ACTUATORS_HPP_
+#define _ACTUATORS_HPP_
+
+#include <cstdint>
+
+#include "hal.hpp"
+
+/**
+ * How many device writes the actuator layer made and how many it left out
+ * because nothing had changed. Counted per smart or ADI port, so a motor
+ * group of two counts as two.
+ */
+struct ActuatorStats {
+	uint32_t sent;
+	uint32_t saved;
+};
+
+/**
+ * Sends a motor or motor group a command only when it differs from the last
+ * one sent, or when KEEP_ALIVE_MS has passed since, so a motor that missed a
+ * write or was plugged back in still picks it up. Every skipped command is a
+ * smart port transaction the tick does not spend.
+ *
+ * \code
+ * hal::MotorGroup leftMotors({-20, -1});
+ * ActuatorStats stats = {};
+ * MotorOutput left(leftMotors, stats);
+ * left.move(power);	// Only goes out when power changes
+ * left.brake();		// Only once, however many ticks it is called for
+ * \endcode
+ */
+class MotorOutput {
+	public:
+	static constexpr uint32_t KEEP_ALIVE_MS = 250;
+
+	MotorOutput(const hal::MotorGroup& motor, ActuatorStats& stats);
+
+	void move(int32_t power);
+	void brake();
+
+	/**
+	 * Makes the next command go out whatever it is, for when something else
+	 * wrote to the motor.
+	 */
+	void invalidate();
+
+	private:
+	enum Command : uint8_t {
+		COMMAND_NONE,
+		COMMAND_MOVE,
+		COMMAND_BRAKE
+	};
+
+	// Whether a command has to be sent, counting it either way
+	bool due(Command command, int32_t power);
+
+	const hal::MotorGroup& motor;
+	ActuatorStats& stats;
+	int ports;
+	Command lastCommand = COMMAND_NONE;
+	int32_t lastPower = 0;
+	uint32_t sentMs = 0;
+};
+
+/**
+ * The same for an ADI digital output such as a piston.
+ */
+class DigitalOutput {
+	public:
+	static constexpr uint32_t KEEP_ALIVE_MS = MotorOutput::KEEP_ALIVE_MS;
+
+	DigitalOutput(const hal::DigitalOut& output, ActuatorStats& stats);
+
+	void set(bool value);
+	void invalidate();
+
+	private:
+	const hal::DigitalOut& output;
+	ActuatorStats& stats;
+	bool valid = false;
+	bool lastValue = false;
+	uint32_t sentMs = 0;
+};
+
+#endif  // _ACTUATORS_HPP_
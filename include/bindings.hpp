@@ -0,0 +1,159 @@
+#ifndef _BINDINGS_HPP_
+#define _BINDINGS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+
+#include "input.hpp"
+
+/**
+ * Everything the driver can ask for from the controller.
+ */
+enum Action {
+	ACTION_GOAL_CLAMP,
+	ACTION_INTAKE_IN,
+	ACTION_INTAKE_OUT,
+	ACTION_RECORD,			// Starts the record countdown or stops a recording
+	ACTION_REPLAY,
+	ACTION_SLOT_NEXT,
+	ACTION_SLOT_PREVIOUS,
+	ACTION_TOGGLE_DRIVE_MODE,
+	ACTION_COUNT
+};
+
+enum Trigger {
+	TRIGGER_DOWN,			// Every tick the buttons are all held
+	TRIGGER_PRESS,			// The tick any of the buttons goes down
+	TRIGGER_RELEASE,
+	TRIGGER_HOLD,
+	TRIGGER_DOUBLE_TAP,
+	TRIGGER_CHORD			// Once when all the buttons are down together
+};
+
+struct Binding {
+	Action action;
+	Trigger trigger;
+	uint16_t buttons;
+};
+
+constexpr uint32_t actionBit(Action action) {
+	return 1u << action;
+}
+
+// The driver's controller layout. Swap buttons here for a different driver;
+// nothing else needs to change. An action may have more than one binding.
+constexpr Binding DRIVER_BINDINGS[] = {
+	{ACTION_GOAL_CLAMP,			TRIGGER_DOWN,	buttonMask(BUTTON_R1)},
+	{ACTION_INTAKE_IN,			TRIGGER_DOWN,	buttonMask(BUTTON_L1)},
+	{ACTION_INTAKE_OUT,			TRIGGER_DOWN,	buttonMask(BUTTON_L2)},
+	{ACTION_RECORD,				TRIGGER_PRESS,	buttonMask(BUTTON_X)},
+	{ACTION_REPLAY,				TRIGGER_PRESS,	buttonMask(BUTTON_A)},
+	{ACTION_SLOT_NEXT,			TRIGGER_PRESS,	buttonMask(BUTTON_UP)},
+	{ACTION_SLOT_PREVIOUS,		TRIGGER_PRESS,	buttonMask(BUTTON_DOWN)},
+	{ACTION_TOGGLE_DRIVE_MODE,	TRIGGER_CHORD,	buttonMask(BUTTON_Y) | buttonMask(BUTTON_B)},
+};
+
+/**
+ * Turns a constexpr binding table into one function that checks every
+ * binding against the input layer and returns the actions asked for, as
+ * actionBit() flags. The table is walked at compile time, so each binding
+ * becomes a few inline mask tests with no loop, virtual call or lookup.
+ *
+ * \code
+ * Bindings<DRIVER_BINDINGS> bindings(input);
+ * uint32_t actions = bindings.evaluate(input);
+ * if (actions & actionBit(ACTION_RECORD)) { ... }
+ * \endcode
+ */
+template <const auto& TABLE>
+class Bindings {
+	static constexpr size_t COUNT = std::size(TABLE);
+
+	static constexpr bool valid() {
+		for (const Binding& binding : TABLE) {
+			if (binding.buttons == 0 || binding.action >= ACTION_COUNT) {
+				return false;
+			}
+			// A chord of one button is just a press
+			if (binding.trigger == TRIGGER_CHORD && (binding.buttons & (binding.buttons - 1)) == 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+	static_assert(valid(), "Every binding needs a button and an action, and every chord at least two buttons");
+
+	// Which of the input layer's chords each chord binding is, in table order
+	static constexpr int chordIndex(size_t index) {
+		int chord = 0;
+		for (size_t i = 0; i < index; i++) {
+			chord += TABLE[i].trigger == TRIGGER_CHORD;
+		}
+		return chord;
+	}
+	static constexpr int CHORD_COUNT = chordIndex(COUNT);
+	static_assert(CHORD_COUNT <= InputLayer::MAX_CHORDS, "Too many chords for the input layer");
+
+	static constexpr uint16_t buttonsUsed() {
+		uint16_t buttons = 0;
+		for (const Binding& binding : TABLE) {
+			buttons |= binding.buttons;
+		}
+		return buttons;
+	}
+
+	public:
+	// Every button the table uses, for InputLayer::readOnly()
+	static constexpr uint16_t BUTTONS = buttonsUsed();
+
+	/**
+	 * Registers the table's chords with the input layer.
+	 */
+	explicit Bindings(InputLayer& input) {
+		for (const Binding& binding : TABLE) {
+			if (binding.trigger == TRIGGER_CHORD) {
+				chords[chordCount++] = input.addChord(binding.buttons);
+			}
+		}
+	}
+
+	/**
+	 * Gets the actions the driver asked for this tick. Call after input.update().
+	 */
+	uint32_t evaluate(const InputLayer& input) const {
+		return evaluateAll(input, std::make_index_sequence<COUNT>());
+	}
+
+	private:
+	template <size_t... I>
+	uint32_t evaluateAll(const InputLayer& input, std::index_sequence<I...>) const {
+		return (evaluateOne<I>(input) | ... | 0u);
+	}
+
+	template <size_t I>
+	uint32_t evaluateOne(const InputLayer& input) const {
+		constexpr Binding binding = TABLE[I];
+		bool fired;
+		if constexpr (binding.trigger == TRIGGER_DOWN) {
+			fired = (input.frame().buttons & binding.buttons) == binding.buttons;
+		} else if constexpr (binding.trigger == TRIGGER_PRESS) {
+			fired = input.pressedButtons() & binding.buttons;
+		} else if constexpr (binding.trigger == TRIGGER_RELEASE) {
+			fired = input.releasedButtons() & binding.buttons;
+		} else if constexpr (binding.trigger == TRIGGER_HOLD) {
+			fired = input.heldButtons() & binding.buttons;
+		} else if constexpr (binding.trigger == TRIGGER_DOUBLE_TAP) {
+			fired = input.doubleTappedButtons() & binding.buttons;
+		} else {
+			fired = input.chord(chords[chordIndex(I)]);
+		}
+		return fired ? actionBit(binding.action) : 0;
+	}
+
+	int chords[CHORD_COUNT > 0 ? CHORD_COUNT : 1] = {};
+	int chordCount = 0;
+};
+
+#endif  // _BINDINGS_HPP_
@@ -0,0 +1,62 @@
+#ifndef _CONTROLLER_OUTPUT_HPP_
+#define _CONTROLLER_OUTPUT_HPP_
+
+#include <cstdint>
+
+#include "pros/apix.h"
+
+/**
+ * Queues text and rumbles for a controller and sends them from its own task.
+ *
+ * The controller ignores anything sent less than 50ms after the last update
+ * over VEXnet, so printing straight from a control loop loses messages when
+ * buttons are pressed quickly. Here each line keeps only its latest text, so
+ * rapid updates to one line merge into one, and the task sends at most one
+ * update per interval. Calls never block.
+ */
+class ControllerOutput {
+	public:
+	static constexpr uint32_t MIN_INTERVAL_MS = 50;
+	static constexpr int LINE_COUNT = 3;
+	static constexpr int LINE_WIDTH = 19;		// Characters the controller screen fits
+	static constexpr int RUMBLE_SIZE = 8;		// Longest pattern the controller accepts
+
+	/**
+	 * Starts the output task. Called once from initialize().
+	 */
+	void start(pros::controller_id_e_t controller = pros::E_CONTROLLER_MASTER);
+
+	/**
+	 * Sets a line of the controller screen, printf style. The rest of the line
+	 * is cleared, and text past LINE_WIDTH is cut off.
+	 */
+	void print(int line, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+	/**
+	 * Queues a rumble, replacing any that has not started yet.
+	 *
+	 * \param pattern
+	 *        Dots for short rumbles, dashes for long ones and spaces for pauses,
+	 *        up to RUMBLE_SIZE characters
+	 */
+	void rumble(const char* pattern);
+
+	private:
+	struct Line {
+		char text[LINE_WIDTH + 1];
+		bool dirty;
+	};
+
+	static void outputTask(void* param);
+
+	pros::controller_id_e_t controller = pros::E_CONTROLLER_MASTER;
+	pros::mutex_t mutex = nullptr;
+	Line lines[LINE_COUNT] = {};
+	char rumblePattern[RUMBLE_SIZE + 1] = {};
+	bool rumblePending = false;
+	int nextLine = 0;		// Dirty lines are sent in turn so one busy line can't starve the others
+};
+
+extern ControllerOutput controllerOutput;
+
+#endif  // _CONTROLLER_OUTPUT_HPP_
@@ -0,0 +1,56 @@
+#ifndef _DISPLAY_HPP_
+#define _DISPLAY_HPP_
+
+#include <cstdint>
+
+#include "pros/apix.h"
+
+/**
+ * Buffers the LLEMU screen so control loops never touch LVGL or the heap.
+ *
+ * Each line has a fixed buffer that print() formats into. Only a line whose
+ * text actually changed is marked dirty, and a low priority task pushes dirty
+ * lines to the screen at a set rate, so a line rewritten every tick costs one
+ * set_text per refresh at most and an unchanged one costs nothing.
+ */
+class Display {
+	public:
+	static constexpr int LINE_COUNT = 8;
+	static constexpr int LINE_SIZE = 64;
+
+	/**
+	 * Starts the task that draws changed lines. Called once from initialize(),
+	 * after pros::lcd::initialize().
+	 *
+	 * \param periodMs
+	 *        How often changed lines are drawn
+	 */
+	void start(uint32_t periodMs = 50);
+
+	/**
+	 * Formats a line, printf style. Text past LINE_SIZE is cut off.
+	 */
+	void print(int line, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+	/**
+	 * Sets a line to plain text.
+	 */
+	void set(int line, const char* text);
+
+	private:
+	struct Line {
+		char text[LINE_SIZE];
+		bool dirty;
+	};
+
+	static void drawTask(void* param);
+	void store(int line, const char* text);
+
+	pros::mutex_t mutex = nullptr;
+	uint32_t periodMs = 50;
+	Line lines[LINE_COUNT] = {};
+};
+
+extern Display display;
+
+#endif  // _DISPLAY_HPP_
@@ -0,0 +1,56 @@
+#ifndef _DRIVE_CONTROL_HPP_
+#define _DRIVE_CONTROL_HPP_
+
+#include <cstdint>
+
+#include "drive_curves.hpp"
+#include "filters.hpp"
+#include "input.hpp"
+
+enum DriveMode {
+	DRIVE_MODE_TANK,
+	DRIVE_MODE_ARCADE
+};
+
+/**
+ * What the driver wants from the drivetrain and mechanisms for one tick.
+ */
+struct DriveCommand {
+	int left;			// -127 to 127
+	int right;
+	int intake;			// -1, 0 or 1
+	bool goalClamp;
+};
+
+/**
+ * The driver's side of the control loop: turns the sticks and the tick's
+ * actions into motor powers through the driver's curves and the channel
+ * filters, and keeps track of the drive mode.
+ */
+class DriveControl {
+	public:
+	// The sticks update() reads in either drive mode, for InputLayer::readOnly()
+	static constexpr uint8_t AXES = axisMask(AXIS_LEFT_Y) | axisMask(AXIS_RIGHT_X) | axisMask(AXIS_RIGHT_Y);
+
+	explicit DriveControl(const DriverProfile& profile = activeDriverProfile(), DriveMode mode = DRIVE_MODE_ARCADE);
+
+	/**
+	 * Works out this tick's command. Call once per tick after input.update().
+	 *
+	 * \param actions
+	 *        The tick's actions from Bindings::evaluate(), only the drive mode,
+	 *        intake and goal clamp ones are used
+	 */
+	DriveCommand update(const InputLayer& input, uint32_t actions);
+
+	DriveMode mode() const;
+
+	private:
+	const DriverProfile& profile;
+	DriveMode driveMode;
+	// One filter per channel, the stages are in filters.hpp
+	DriveFilter leftFilter, rightFilter, forwardFilter;
+	TurnFilter turnFilter;
+};
+
+#endif  // _DRIVE_CONTROL_HPP_
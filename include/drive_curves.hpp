@@ -0,0 +1,117 @@
+#ifndef _DRIVE_CURVES_HPP_
+#define _DRIVE_CURVES_HPP_
+
+#include <cstdint>
+
+/**
+ * How a stick's travel maps onto drive output. Stored in replay files, so
+ * only ever add to the end.
+ */
+enum DriveCurve : uint8_t {
+	CURVE_LINEAR,		// Output is the stick value, as before curves existed
+	CURVE_EXPO,			// Blend of linear and cubic, finer near the middle but still quick off it
+	CURVE_CUBIC,		// Stick value cubed, very fine near the middle
+	CURVE_PIECEWISE,	// Slow up to two thirds of the way, then climbs to full
+	CURVE_COUNT
+};
+
+constexpr const char* driveCurveName(uint8_t curve) {
+	switch (curve) {
+		case CURVE_LINEAR: return "linear";
+		case CURVE_EXPO: return "expo";
+		case CURVE_CUBIC: return "cubic";
+		case CURVE_PIECEWISE: return "piecewise";
+	}
+	return "unknown";
+}
+
+/**
+ * Which curve each controller stick axis goes through, in Axis order.
+ */
+struct DriverProfile {
+	const char* name;
+	DriveCurve curves[4];	// Left X, left Y, right X, right Y
+};
+
+// Add a driver here and point ACTIVE_DRIVER_PROFILE at them
+constexpr DriverProfile DRIVER_PROFILES[] = {
+	{"Linear", {CURVE_LINEAR, CURVE_LINEAR, CURVE_LINEAR, CURVE_LINEAR}},
+	{"Smooth", {CURVE_LINEAR, CURVE_EXPO, CURVE_EXPO, CURVE_EXPO}},
+	{"Precise", {CURVE_LINEAR, CURVE_EXPO, CURVE_CUBIC, CURVE_EXPO}},
+	{"Late", {CURVE_LINEAR, CURVE_PIECEWISE, CURVE_PIECEWISE, CURVE_PIECEWISE}},
+};
+constexpr int ACTIVE_DRIVER_PROFILE = 0;
+
+static_assert(ACTIVE_DRIVER_PROFILE >= 0 && ACTIVE_DRIVER_PROFILE < int(sizeof(DRIVER_PROFILES) / sizeof(DriverProfile)),
+              "ACTIVE_DRIVER_PROFILE is not in DRIVER_PROFILES");
+
+constexpr const DriverProfile& activeDriverProfile() {
+	return DRIVER_PROFILES[ACTIVE_DRIVER_PROFILE];
+}
+
+/**
+ * Every curve worked out for every stick value at compile time. Indexed by
+ * stick value + 128, so any int8_t is in range and -128 maps like -127.
+ */
+struct CurveTables {
+	int8_t values[CURVE_COUNT][256];
+};
+
+namespace curves_detail {
+// Output for a stick value of 0 to 127
+constexpr int curvePoint(DriveCurve curve, int x) {
+	double t = x / 127.0;
+	double y = t;
+	switch (curve) {
+		case CURVE_LINEAR:
+		case CURVE_COUNT:
+			y = t;
+			break;
+		case CURVE_EXPO:
+			y = 0.4 * t + 0.6 * t * t * t;
+			break;
+		case CURVE_CUBIC:
+			y = t * t * t;
+			break;
+		case CURVE_PIECEWISE: {
+			// Straight lines through (0, 0), (40, 15), (90, 60) and (127, 127)
+			constexpr double points[4][2] = {{0, 0}, {40, 15}, {90, 60}, {127, 127}};
+			for (int i = 1; i < 4; i++) {
+				if (x <= points[i][0]) {
+					double fraction = (x - points[i - 1][0]) / (points[i][0] - points[i - 1][0]);
+					y = (points[i - 1][1] + (points[i][1] - points[i - 1][1]) * fraction) / 127.0;
+					break;
+				}
+			}
+			break;
+		}
+	}
+	return int(y * 127.0 + 0.5);
+}
+
+constexpr CurveTables makeCurveTables() {
+	CurveTables tables = {};
+	for (int curve = 0; curve < CURVE_COUNT; curve++) {
+		for (int value = -128; value <= 127; value++) {
+			int magnitude = value < 0 ? (value == -128 ? 127 : -value) : value;
+			int output = curvePoint(DriveCurve(curve), magnitude);
+			tables.values[curve][value + 128] = int8_t(value < 0 ? -output : output);
+		}
+	}
+	return tables;
+}
+}  // namespace curves_detail
+
+inline constexpr CurveTables CURVE_TABLES = curves_detail::makeCurveTables();
+
+static_assert(CURVE_TABLES.values[CURVE_EXPO][127 + 128] == 127 && CURVE_TABLES.values[CURVE_CUBIC][-127 + 128] == -127,
+              "Every curve reaches full output at full stick");
+
+/**
+ * Puts a stick value through a curve, one table load.
+ */
+inline int applyCurve(DriveCurve curve, int8_t value) {
+	return CURVE_TABLES.values[curve][value + 128];
+}
+
+#endif  // _DRIVE_CURVES_HPP_
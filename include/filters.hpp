@@ -0,0 +1,167 @@
+#ifndef _FILTERS_HPP_
+#define _FILTERS_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+/**
+ * Zeroes anything within WIDTH of zero, for sticks that do not quite centre.
+ */
+template <int WIDTH>
+class Deadband {
+	static_assert(WIDTH >= 0, "WIDTH is a distance from zero");
+
+	public:
+	int apply(int value) {
+		return value >= -WIDTH && value <= WIDTH ? 0 : value;
+	}
+
+	void reset(int) {}
+};
+
+/**
+ * Limits how far the output moves per tick. RISE is the most it may move away
+ * from zero and FALL the most back towards it, so speeding up can be gentle
+ * while stopping stays quick. A change of sign falls to zero before rising
+ * the other way.
+ */
+template <int RISE, int FALL = RISE>
+class SlewRate {
+	static_assert(RISE > 0 && FALL > 0, "A limit of 0 would never move");
+
+	public:
+	int apply(int target) {
+		int delta = target - value;
+		bool away = delta > 0 ? value >= 0 : value <= 0;
+		int limit = away ? RISE : FALL;
+		delta = std::clamp(delta, -limit, limit);
+		if (!away && ((value > 0 && value + delta < 0) || (value < 0 && value + delta > 0))) {
+			delta = -value;
+		}
+		value += delta;
+		return value;
+	}
+
+	void reset(int to) {
+		value = to;
+	}
+
+	private:
+	int value = 0;
+};
+
+/**
+ * Exponential moving average, moving NUM / DEN of the way to the input each
+ * tick. Kept in 1/256ths and always moved at least one of those, so unlike
+ * rounding to an int every tick it settles exactly on a steady input.
+ */
+template <int NUM, int DEN>
+class Ema {
+	static_assert(NUM > 0 && NUM <= DEN, "The weight NUM / DEN has to be in (0, 1]");
+
+	public:
+	int apply(int input) {
+		int32_t target = int32_t(input) * SCALE;
+		int32_t step = (target - scaled) * NUM / DEN;
+		if (step == 0 && target != scaled) {
+			step = target > scaled ? 1 : -1;
+		}
+		scaled += step;
+		return (scaled + (scaled >= 0 ? SCALE / 2 : -SCALE / 2)) / SCALE;
+	}
+
+	void reset(int to) {
+		scaled = int32_t(to) * SCALE;
+	}
+
+	private:
+	static constexpr int32_t SCALE = 256;
+
+	int32_t scaled = 0;
+};
+
+/**
+ * Median of the last N inputs, which throws out single-tick spikes without
+ * smearing them like an average. Adds N / 2 ticks of lag.
+ */
+template <size_t N>
+class Median {
+	static_assert(N % 2 == 1 && N <= 9, "N has to be odd, and small enough to sort every tick");
+
+	public:
+	int apply(int input) {
+		history[next] = int16_t(input);
+		next = (next + 1) % N;
+		if (count < N) {
+			count++;
+		}
+		int16_t sorted[N];
+		std::copy(history, history + count, sorted);
+		for (size_t i = 1; i < count; i++) {		// Insertion sort, N is tiny
+			int16_t value = sorted[i];
+			size_t j = i;
+			for (; j > 0 && sorted[j - 1] > value; j--) {
+				sorted[j] = sorted[j - 1];
+			}
+			sorted[j] = value;
+		}
+		return sorted[count / 2];
+	}
+
+	void reset(int to) {
+		std::fill(history, history + N, int16_t(to));
+		count = N;
+		next = 0;
+	}
+
+	private:
+	int16_t history[N] = {};
+	size_t count = 0;		// Until N inputs have come in, the median of those there are
+	size_t next = 0;
+};
+
+/**
+ * Runs a value through each stage in order. Every stage keeps its own state
+ * in the pipeline, so one pipeline per channel, and the stages are fixed at
+ * compile time so a tick is straight-line code with no virtual calls.
+ *
+ * \code
+ * FilterPipeline<Deadband<5>, Median<3>, SlewRate<20>> forward;
+ * int power = forward.apply(input.axis(AXIS_LEFT_Y));
+ * \endcode
+ */
+template <typename... Stages>
+class FilterPipeline {
+	public:
+	int apply(int value) {
+		return applyAll(value, std::index_sequence_for<Stages...>());
+	}
+
+	/**
+	 * Sets every stage as if it had settled on a value, for starting over
+	 * without a jump.
+	 */
+	void reset(int to = 0) {
+		std::apply([to](auto&... stage) { (stage.reset(to), ...); }, stages);
+	}
+
+	private:
+	template <size_t... I>
+	int applyAll(int value, std::index_sequence<I...>) {
+		((value = std::get<I>(stages).apply(value)), ...);
+		return value;
+	}
+
+	std::tuple<Stages...> stages;
+};
+
+// The control loop's channels, per tick at a 20ms loop. Stages go here; the
+// loop only calls apply().
+using DriveFilter = FilterPipeline<SlewRate<24, 127>>;	// Full speed in 6 ticks, stops in 1
+using TurnFilter = FilterPipeline<Ema<1, 5>>;			// The smoothing arcade turn always had
+using IntakeFilter = FilterPipeline<SlewRate<64>>;		// Reverses over 4 ticks, easier on the motors
+
+#endif  // _FILTERS_HPP_
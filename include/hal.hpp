@@ -0,0 +1,45 @@
+#ifndef _HAL_HPP_
+#define _HAL_HPP_
+
+// The few pieces of hardware the control code touches, behind one set of
+// names so that code builds for the brain and for the host alike.
+//
+// The backend is picked at compile time. The robot build gets hal_pros.hpp,
+// where everything is an inline call straight through to PROS, so it costs
+// nothing over calling PROS directly. Building with -DHAL_MOCK gets
+// hal_mock.hpp instead, which keeps every device in memory and time on a
+// clock that only moves when told to, so host tools can drive the control
+// code tick by tick and get the same result every run.
+//
+// Both backends provide, in namespace hal:
+//
+//   uint32_t millis();
+//   uint64_t micros();
+//   std::string storagePath(const std::string& name);	// Where files live, /usd/ on the brain
+//
+//   class MotorGroup {
+//       MotorGroup(std::initializer_list<int8_t> ports);	// Negative ports run reversed
+//       void move(int32_t power) const;	// -127 to 127
+//       void brake() const;
+//       double position() const;			// Degrees, of the first motor
+//       double velocity() const;			// RPM, of the first motor
+//       int size() const;					// Motors in the group
+//   };
+//
+//   class DigitalOut {
+//       DigitalOut(char port);				// 'A' to 'H'
+//       void set(bool value) const;
+//   };
+//
+//   class Controller {
+//       bool digital(int button) const;	// In the order of pros::controller_digital_e_t from L1
+//       int analog(int axis) const;		// In the order of pros::controller_analog_e_t, -127 to 127
+//   };
+
+#ifdef HAL_MOCK
+#include "hal_mock.hpp"
+#else
+#include "hal_pros.hpp"
+#endif
+
+#endif  // _HAL_HPP_
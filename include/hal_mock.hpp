@@ -0,0 +1,158 @@
+#ifndef _HAL_MOCK_HPP_
+#define _HAL_MOCK_HPP_
+
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+#include <string>
+
+// The host backend for hal.hpp, include that with -DHAL_MOCK rather than this.
+// Header only so nothing of it ends up in the robot build.
+
+namespace hal {
+
+/**
+ * Everything the mock devices read and write. A test or simulator sets the
+ * inputs, runs the code under test and reads back what it commanded.
+ */
+namespace mock {
+
+constexpr int MOTOR_PORTS = 21;
+constexpr int ADI_PORTS = 8;
+
+/**
+ * One smart port motor, seen from its shaft, so reversing it in a group
+ * does not change which way the shaft turns for a given power here.
+ */
+struct Motor {
+	int32_t power;			// Last move(), -127 to 127
+	bool braking;			// brake() since the last move()
+	double position;		// Degrees, for the simulator to set
+	double velocity;		// RPM, for the simulator to set
+	uint32_t writes;		// Commands the code sent the motor
+};
+
+inline Motor motors[MOTOR_PORTS + 1] = {};		// By port number, 0 is unused
+inline bool digitalOuts[ADI_PORTS] = {};		// By port, 0 for 'A'
+inline uint32_t digitalWrites[ADI_PORTS] = {};
+inline uint16_t controllerButtons = 0;			// Bit per button from L1
+inline int8_t controllerAxes[4] = {};
+inline uint64_t timeUs = 0;
+inline std::string storageRoot = "./";
+
+inline void advance(uint64_t us) {
+	timeUs += us;
+}
+
+/**
+ * Puts every device and the clock back how they start.
+ */
+inline void reset() {
+	for (Motor& motor : motors) {
+		motor = {};
+	}
+	for (int i = 0; i < ADI_PORTS; i++) {
+		digitalOuts[i] = false;
+		digitalWrites[i] = 0;
+	}
+	controllerButtons = 0;
+	for (int8_t& axis : controllerAxes) {
+		axis = 0;
+	}
+	timeUs = 0;
+}
+
+}  // namespace mock
+
+inline uint32_t millis() {
+	return uint32_t(mock::timeUs / 1000);
+}
+
+inline uint64_t micros() {
+	return mock::timeUs;
+}
+
+inline std::string storagePath(const std::string& name) {
+	return mock::storageRoot + name;
+}
+
+class MotorGroup {
+	public:
+	static constexpr int MAX_MOTORS = 8;
+
+	MotorGroup(std::initializer_list<int8_t> ports) {
+		for (int8_t port : ports) {
+			if (count < MAX_MOTORS && std::abs(port) >= 1 && std::abs(port) <= mock::MOTOR_PORTS) {
+				this->ports[count++] = port;
+			}
+		}
+	}
+
+	void move(int32_t power) const {
+		for (int i = 0; i < count; i++) {
+			mock::Motor& motor = mock::motors[std::abs(ports[i])];
+			motor.power = ports[i] < 0 ? -power : power;
+			motor.braking = false;
+			motor.writes++;
+		}
+	}
+
+	void brake() const {
+		for (int i = 0; i < count; i++) {
+			mock::Motor& motor = mock::motors[std::abs(ports[i])];
+			motor.power = 0;
+			motor.braking = true;
+			motor.writes++;
+		}
+	}
+
+	double position() const {
+		return count > 0 ? sign(0) * mock::motors[std::abs(ports[0])].position : 0;
+	}
+
+	double velocity() const {
+		return count > 0 ? sign(0) * mock::motors[std::abs(ports[0])].velocity : 0;
+	}
+
+	int size() const {
+		return count;
+	}
+
+	private:
+	double sign(int i) const {
+		return ports[i] < 0 ? -1 : 1;
+	}
+
+	int8_t ports[MAX_MOTORS] = {};
+	int count = 0;
+};
+
+class DigitalOut {
+	public:
+	DigitalOut(char port) : index(port >= 'a' ? port - 'a' : port - 'A') {}
+
+	void set(bool value) const {
+		if (index >= 0 && index < mock::ADI_PORTS) {
+			mock::digitalOuts[index] = value;
+			mock::digitalWrites[index]++;
+		}
+	}
+
+	private:
+	int index;
+};
+
+class Controller {
+	public:
+	bool digital(int button) const {
+		return mock::controllerButtons & (1u << button);
+	}
+
+	int analog(int axis) const {
+		return mock::controllerAxes[axis];
+	}
+};
+
+}  // namespace hal
+
+#endif  // _HAL_MOCK_HPP_
@@ -0,0 +1,86 @@
+#ifndef _HAL_PROS_HPP_
+#define _HAL_PROS_HPP_
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+
+#include "pros/adi.hpp"
+#include "pros/apix.h"
+#include "pros/motor_group.hpp"
+
+// The robot's backend for hal.hpp, include that rather than this.
+
+namespace hal {
+
+inline uint32_t millis() {
+	return pros::millis();
+}
+
+inline uint64_t micros() {
+	return pros::micros();
+}
+
+inline std::string storagePath(const std::string& name) {
+	return "/usd/" + name;
+}
+
+class MotorGroup {
+	public:
+	MotorGroup(std::initializer_list<int8_t> ports) : motors(ports) {}
+
+	void move(int32_t power) const {
+		motors.move(power);
+	}
+
+	void brake() const {
+		motors.brake();
+	}
+
+	double position() const {
+		return motors.get_position();
+	}
+
+	double velocity() const {
+		return motors.get_actual_velocity();
+	}
+
+	int size() const {
+		return motors.size();
+	}
+
+	private:
+	pros::MotorGroup motors;
+};
+
+class DigitalOut {
+	public:
+	DigitalOut(char port) : output(port) {}
+
+	void set(bool value) const {
+		output.set_value(value);
+	}
+
+	private:
+	pros::adi::DigitalOut output;
+};
+
+class Controller {
+	public:
+	Controller(pros::controller_id_e_t id = pros::E_CONTROLLER_MASTER) : id(id) {}
+
+	bool digital(int button) const {
+		return pros::c::controller_get_digital(id, pros::controller_digital_e_t(pros::E_CONTROLLER_DIGITAL_L1 + button));
+	}
+
+	int analog(int axis) const {
+		return pros::c::controller_get_analog(id, pros::controller_analog_e_t(axis));
+	}
+
+	private:
+	pros::controller_id_e_t id;
+};
+
+}  // namespace hal
+
+#endif  // _HAL_PROS_HPP_
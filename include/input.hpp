@@ -0,0 +1,184 @@
+#ifndef _INPUT_HPP_
+#define _INPUT_HPP_
+
+#include <cstdint>
+
+#include "hal.hpp"
+
+/**
+ * Controller buttons, in the order of pros::controller_digital_e_t.
+ */
+enum Button : uint8_t {
+	BUTTON_L1,
+	BUTTON_L2,
+	BUTTON_R1,
+	BUTTON_R2,
+	BUTTON_UP,
+	BUTTON_DOWN,
+	BUTTON_LEFT,
+	BUTTON_RIGHT,
+	BUTTON_X,
+	BUTTON_B,
+	BUTTON_Y,
+	BUTTON_A,
+	BUTTON_COUNT
+};
+
+/**
+ * Controller sticks, in the order of pros::controller_analog_e_t.
+ */
+enum Axis : uint8_t {
+	AXIS_LEFT_X,
+	AXIS_LEFT_Y,
+	AXIS_RIGHT_X,
+	AXIS_RIGHT_Y,
+	AXIS_COUNT
+};
+
+constexpr uint16_t buttonMask(Button button) {
+	return uint16_t(1u << button);
+}
+
+constexpr uint8_t axisMask(Axis axis) {
+	return uint8_t(1u << axis);
+}
+
+constexpr uint16_t ALL_BUTTONS = (1u << BUTTON_COUNT) - 1;
+constexpr uint8_t ALL_AXES = (1u << AXIS_COUNT) - 1;
+
+/**
+ * Everything on the controller at one instant.
+ */
+struct InputFrame {
+	uint32_t timeMs;		// hal::millis() when it was read
+	uint16_t buttons;		// Bit per Button, set while held down
+	int8_t axes[AXIS_COUNT];	// -127 to 127
+};
+
+enum InputEventType {
+	INPUT_PRESS,
+	INPUT_RELEASE,
+	INPUT_HOLD,			// Held down for InputTiming::holdMs, once per press
+	INPUT_DOUBLE_TAP,	// Pressed again within InputTiming::doubleTapMs of the last press
+	INPUT_CHORD			// Every button of a registered chord is down
+};
+
+struct InputEvent {
+	InputEventType type;
+	uint16_t buttons;	// The button's mask, or the whole chord's
+};
+
+struct InputTiming {
+	uint32_t holdMs = 500;
+	uint32_t doubleTapMs = 300;
+	uint32_t chordWindowMs = 0;		// Longest between the first and last press of a chord, 0 for no limit
+};
+
+/**
+ * Reads the whole controller once per tick and turns it into events, so a
+ * control loop asks this instead of calling get_digital and
+ * get_digital_new_press on the controller over and over.
+ *
+ * \code
+ * InputLayer input;
+ * int driveModeChord = input.addChord(buttonMask(BUTTON_Y) | buttonMask(BUTTON_B));
+ * while (true) {
+ *     input.update();
+ *     if (input.chord(driveModeChord)) { ... }
+ *     if (input.pressed(BUTTON_X)) { ... }
+ *     int forward = input.axis(AXIS_LEFT_Y);
+ * }
+ * \endcode
+ */
+class InputLayer {
+	public:
+	static constexpr int MAX_CHORDS = 4;
+	static constexpr int MAX_EVENTS = 16;	// Per tick, any more are dropped
+
+	explicit InputLayer(hal::Controller controller = {}, InputTiming timing = {});
+
+	/**
+	 * Registers buttons that count as a chord when all are held together. A
+	 * chord fires once, and again only after all of its buttons are released.
+	 *
+	 * \return The chord's id for chord(), -1 if MAX_CHORDS are registered
+	 */
+	int addChord(uint16_t buttons);
+
+	/**
+	 * Limits update() to the buttons and sticks something uses, since each
+	 * one is a separate read from the controller. The rest read as up and
+	 * centred. Everything is read until this is called.
+	 *
+	 * \param buttons
+	 *        buttonMask() bits, e.g. Bindings<TABLE>::BUTTONS
+	 * \param axes
+	 *        axisMask() bits, e.g. DriveControl::AXES
+	 */
+	void readOnly(uint16_t buttons, uint8_t axes);
+
+	/**
+	 * Reads the controller and works out this tick's events. Call once at
+	 * the top of each loop.
+	 */
+	void update();
+
+	/**
+	 * Works out this tick's events from a frame read elsewhere.
+	 */
+	void update(const InputFrame& frame);
+
+	const InputFrame& frame() const;
+
+	bool down(Button button) const;
+	bool pressed(Button button) const;		// Went down this tick
+	bool released(Button button) const;		// Came up this tick
+	bool held(Button button) const;			// Reached the hold time this tick
+	bool doubleTapped(Button button) const;
+
+	// The same as masks of every button, for checking several at once
+	uint16_t pressedButtons() const;
+	uint16_t releasedButtons() const;
+	uint16_t heldButtons() const;
+	uint16_t doubleTappedButtons() const;
+
+	/**
+	 * True on the tick a chord from addChord() completes.
+	 */
+	bool chord(int id) const;
+
+	int axis(Axis axis) const;
+
+	/**
+	 * This tick's events, presses and releases first.
+	 */
+	const InputEvent* events() const;
+	int eventCount() const;
+
+	private:
+	void addEvent(InputEventType type, uint16_t buttons);
+
+	hal::Controller controller;
+	InputTiming timing;
+	uint16_t readButtons = ALL_BUTTONS;
+	uint8_t readAxes = ALL_AXES;
+	InputFrame current = {};
+	uint16_t pressedMask = 0;
+	uint16_t releasedMask = 0;
+	uint16_t heldMask = 0;
+	uint16_t doubleTapMask = 0;
+	uint16_t holdDone = 0;			// Buttons whose hold already fired this press
+	uint32_t pressTime[BUTTON_COUNT] = {};
+	uint32_t lastTapTime[BUTTON_COUNT] = {};
+	uint16_t tapArmed = 0;			// Buttons whose last press could start a double tap
+
+	uint16_t chords[MAX_CHORDS] = {};
+	int chordCount = 0;
+	uint8_t chordsArmed = 0;
+	uint8_t chordsFired = 0;
+
+	InputEvent eventBuffer[MAX_EVENTS];
+	int bufferedEvents = 0;
+};
+
+#endif  // _INPUT_HPP_
@@ -0,0 +1,138 @@
+#ifndef _LOOP_STATS_HPP_
+#define _LOOP_STATS_HPP_
+
+#include <cstdint>
+#include <cstddef>
+
+#include "pros/apix.h"
+#include "scheduler.hpp"
+
+/**
+ * Fixed bucket histogram of durations, cheap enough to add to every loop.
+ */
+class LatencyHistogram {
+	public:
+	static constexpr uint32_t BUCKET_US = 100;
+	static constexpr int BUCKET_COUNT = 320;		// Up to 32ms, the last bucket takes anything longer
+
+	void add(uint32_t us);
+	void clear();
+	uint32_t count() const;
+	uint32_t max() const;
+
+	/**
+	 * Gets the duration that a fraction of the samples were at or under,
+	 * rounded up to the end of its bucket.
+	 *
+	 * \param fraction
+	 *        0.5 for the median, 0.99 for p99
+	 */
+	uint32_t percentile(float fraction) const;
+
+	private:
+	uint32_t buckets[BUCKET_COUNT] = {};
+	uint32_t total = 0;
+	uint32_t largest = 0;
+};
+
+/**
+ * A snapshot of a loop's timing, small enough to pass through a queue.
+ */
+struct LoopReport {
+	char name[16];
+	uint32_t timeMs;		// pros::millis() when the report was made
+	uint32_t count;			// Loop iterations measured
+	uint32_t periodP50;		// Microseconds from the start of one iteration to the next
+	uint32_t periodP99;
+	uint32_t periodMax;
+	uint32_t workP50;		// Microseconds spent in the loop body, not waiting
+	uint32_t workP99;
+	uint32_t workMax;
+	uint32_t overruns;		// Iterations whose work took longer than the budget
+	uint32_t late;			// Ticks that started after their deadline, PeriodicScheduler::overruns()
+	uint32_t skipped;		// Whole periods dropped to get back on the grid
+};
+
+/**
+ * Measures a control loop's period and work time with pros::micros().
+ *
+ * \code
+ * LoopStats stats("opcontrol", 20000);
+ * while (true) {
+ *     stats.begin();
+ *     // Work
+ *     stats.end();
+ *     scheduler.wait();
+ * }
+ * \endcode
+ */
+class LoopStats {
+	public:
+	/**
+	 * \param budgetUs
+	 *        How long the loop body may take, usually the loop period
+	 */
+	LoopStats(const char* name, uint32_t budgetUs);
+
+	/**
+	 * Marks the start of an iteration. Call at the top of the loop.
+	 */
+	void begin();
+
+	/**
+	 * Marks the end of an iteration's work. Call just before waiting for the
+	 * next tick.
+	 */
+	void end();
+
+	/**
+	 * Builds a report, with the deadlines the loop's scheduler has missed
+	 * since it was started.
+	 */
+	LoopReport report(const PeriodicScheduler& scheduler) const;
+	void clear();
+
+	private:
+	const char* name;
+	uint32_t budgetUs;
+	uint64_t lastBegin = 0;
+	LatencyHistogram period;
+	LatencyHistogram work;
+	uint32_t overrunCount = 0;
+};
+
+/**
+ * Formats a report for the LCD, like
+ * "opcontrol 20.0/20.3/24.1ms work 2.1/5.0ms 3 over 2 late/1 skip".
+ */
+void loopReportText(const LoopReport& report, char* text, size_t size);
+
+/**
+ * Writes loop reports to the serial port and appends them to a CSV file on the
+ * SD card. Both are done by a low priority task, so publishing from a control
+ * loop never waits on either.
+ */
+class LoopStatsLog {
+	public:
+	static constexpr const char* FILE_PATH = "/usd/loopstats.csv";
+
+	/**
+	 * Creates the queue and the logging task. Called once from initialize().
+	 */
+	void start();
+
+	/**
+	 * Queues a report to be logged. Does not block; the report is dropped if
+	 * the queue is full.
+	 */
+	void publish(const LoopReport& report);
+
+	private:
+	static void logTask(void* param);
+
+	pros::c::queue_t reports = nullptr;
+};
+
+extern LoopStatsLog loopStatsLog;
+
+#endif  // _LOOP_STATS_HPP_
@@ -0,0 +1,83 @@
+#ifndef _PROFILER_HPP_
+#define _PROFILER_HPP_
+
+#include <cstdint>
+
+// Per-stage timing probes for the control loop. Build with "make PROFILE=1"
+// to turn them on; otherwise every probe macro expands to nothing and none of
+// this is compiled in.
+
+/**
+ * The parts of a control loop that are timed separately.
+ */
+enum ProfileStage {
+	STAGE_CONTROLLER_READ,		// get_digital, get_analog
+	STAGE_DRIVE_MATH,			// Drive mode mixing
+	STAGE_RECORD_REPLAY,		// Passing the tick to and from the replay task
+	STAGE_MOTORS,				// MotorGroup and ADI writes
+	STAGE_LCD,					// Publishing state for the UI task
+	STAGE_COUNT
+};
+
+#ifdef PROFILE_STAGES
+
+/**
+ * Adds up the time spent in each stage, a loop iteration at a time. Only
+ * meant to be used from one task.
+ *
+ * A loop body is split into stages with lap(), which charges everything since
+ * the last lap to that stage.
+ */
+class StageProfiler {
+	public:
+	/**
+	 * Ends the current lap and starts timing a new one as the given stage.
+	 */
+	void lap(ProfileStage stage);
+
+	/**
+	 * Ends a loop iteration, folding its stage times into the totals.
+	 */
+	void tick();
+
+	/**
+	 * Prints each stage's average and worst time per iteration to the serial
+	 * port, then starts counting again.
+	 */
+	void report();
+
+	private:
+	bool lapping = false;
+	ProfileStage lapStage = STAGE_CONTROLLER_READ;
+	uint64_t lapStart = 0;
+	uint32_t tickUs[STAGE_COUNT] = {};		// This iteration so far
+	uint64_t totalUs[STAGE_COUNT] = {};
+	uint32_t maxUs[STAGE_COUNT] = {};
+	uint32_t ticks = 0;
+};
+
+extern StageProfiler stageProfiler;
+
+/** Charges everything from here to the next lap or tick to a stage. */
+#define PROFILE_LAP(stage) stageProfiler.lap(stage)
+/** Ends a loop iteration. */
+#define PROFILE_TICK() stageProfiler.tick()
+/** Prints the stage times to the serial port every so many iterations. */
+#define PROFILE_REPORT_EVERY(ticks) \
+	do { \
+		static uint32_t profileTicks = 0; \
+		if (++profileTicks >= (ticks)) { \
+			profileTicks = 0; \
+			stageProfiler.report(); \
+		} \
+	} while (0)
+
+#else
+
+#define PROFILE_LAP(stage) ((void)0)
+#define PROFILE_TICK() ((void)0)
+#define PROFILE_REPORT_EVERY(ticks) ((void)0)
+
+#endif  // PROFILE_STAGES
+
+#endif  // _PROFILER_HPP_
@@ -0,0 +1,339 @@
+#ifndef _REPLAY_HPP_
+#define _REPLAY_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "pros/apix.h"
+#include "replay_format.hpp"
+#include "spsc_ring.hpp"
+
+/**
+ * Gets the path on the SD card of a replay slot's file with an extension, the
+ * first of its two replay files for "bin".
+ */
+std::string replayFilePath(int slot, const char* extension = "bin");
+
+/**
+ * Gets the path of one of the two files a slot is saved to in turn, see
+ * ReplayGeneration. Copy 0 is replayN.bin, so replays saved before there were
+ * two files still load, and copy 1 is replayNb.bin.
+ */
+std::string replayCopyPath(int slot, int copy);
+
+/**
+ * Finds which of a slot's two files holds its newest finished save, reading
+ * only the start and end of each.
+ *
+ * \param generation
+ *        Set to that save's generation, 0 if there is none
+ *
+ * \return The copy, or -1 if neither file holds a finished save
+ */
+int replayNewestCopy(int slot, uint32_t& generation);
+
+/**
+ * A replay held in RAM. Every format is converted to an encoded event stream
+ * when it is loaded, so they are all played back the same way.
+ */
+struct CachedReplay {
+	ReplayInfo info;
+	std::vector<uint8_t> payload;
+	bool recovered;		// Only the part before a damaged block could be read
+};
+
+/**
+ * Reads and validates a whole replay file of any format.
+ *
+ * \return nullptr if the file is missing or nothing in it is valid
+ */
+std::shared_ptr<CachedReplay> replayLoadFile(const std::string& filePath);
+
+/**
+ * Reads a slot's newest save that validates. If both of its files were cut
+ * off or damaged, whatever could be recovered from one of them is used.
+ *
+ * \return nullptr if neither file holds anything valid
+ */
+std::shared_ptr<CachedReplay> replayLoadSlot(int slot);
+
+/**
+ * Keeps every replay slot loaded and validated in RAM, so choosing a slot and
+ * starting a replay never touch the SD card.
+ *
+ * Slots are loaded by a low priority task with replayLoadSlot(), and reloaded
+ * after a recording is saved. A replay that is being played keeps its copy
+ * alive through the shared_ptr even if the slot is reloaded underneath it.
+ *
+ * Each slot's whole event stream stays in RAM. A replay with a trajectory
+ * costs about 7 bytes a tick while the robot moves, so about 21KB for a
+ * minute at 20ms, and ten such slots about 210KB. Loading a slot briefly
+ * holds its file as well. Recordings have no length limit, so a long one
+ * costs the cache the same again per minute.
+ */
+class ReplayCache {
+	public:
+	/**
+	 * Starts loading every slot in the background. Safe to call more than once.
+	 */
+	void start();
+
+	/**
+	 * Queues a slot to be read from the SD card again.
+	 */
+	void reload(int slot);
+
+	/**
+	 * Gets a loaded slot.
+	 *
+	 * \return nullptr if the slot is empty, invalid or not loaded yet
+	 */
+	std::shared_ptr<const CachedReplay> get(int slot);
+
+	/**
+	 * Builds a line like "Slots 0 1 - 3* - - - - - -" showing which slots hold a
+	 * valid replay, with a star on replays that were only partly recovered.
+	 */
+	std::string validSlotsText();
+
+	private:
+	static void loadTask(void* param);
+	static std::shared_ptr<const CachedReplay> load(int slot);
+	void store(int slot, std::shared_ptr<const CachedReplay> replay);
+
+	pros::mutex_t mutex = nullptr;
+	pros::c::queue_t reloads = nullptr;
+	std::shared_ptr<const CachedReplay> slots[REPLAY_SLOT_COUNT];
+};
+
+extern ReplayCache replayCache;
+
+/**
+ * Plays back a replay, from the replay cache if the slot is loaded and
+ * otherwise streamed off the SD card.
+ *
+ * When streaming, a background task fills two fixed chunk buffers, so
+ * playback can start as soon as the first chunk is in and never has to hold
+ * the whole replay, whatever its format or length. The reader owns about
+ * 2.3KB of buffers, so keep it static rather than on a task stack.
+ */
+class ReplayReader {
+	public:
+	static constexpr int CHUNK_SIZE = 50;	// One second of ticks per chunk
+
+	/**
+	 * Opens a replay slot. If the slot is not cached, blocks until the first
+	 * chunk has been read off the SD card.
+	 *
+	 * \return True if the file was opened and has at least one iteration
+	 */
+	bool open(int slot);
+
+	/**
+	 * Gets the next iteration of the replay, waiting for the background task if
+	 * the next chunk is not ready yet.
+	 *
+	 * \return False once the end of the replay is reached
+	 */
+	bool next(Iteration& iteration);
+
+	/**
+	 * Gets what the replay was doing a set time after it started, blending the
+	 * iterations either side. Playback that looks up by time stays in step with
+	 * the recording even when a loop runs late. The time must never go back.
+	 *
+	 * \return False once the time is past the end of the replay
+	 */
+	bool at(uint64_t elapsedUs, Iteration& iteration);
+
+	/**
+	 * Milliseconds between the iterations of the open replay.
+	 */
+	uint16_t tickMs() const;
+
+	/**
+	 * True if the open replay recorded where the drive was, so it can be played
+	 * back closed loop with TrajectoryFollower.
+	 */
+	bool hasTrajectory() const;
+
+	/**
+	 * Stops the background task and closes the file. Safe to call more than once.
+	 */
+	void close();
+
+	/**
+	 * True if the SD card read failed or could not keep up with playback.
+	 */
+	bool failed() const;
+
+	private:
+	static void fillTask(void* param);
+	size_t fillChunk(Iteration* chunk);
+	bool readBlock();
+
+	std::shared_ptr<const CachedReplay> cached;		// Set when playing from the replay cache
+	const uint8_t* cachedPosition = nullptr;
+
+	FILE* file = nullptr;
+	ReplayInfo info;
+	uint32_t remaining = 0;		// Iterations left in the file for the background task to read
+
+	// Replays are read through a small byte window and converted a chunk at a time. It holds a
+	// whole block of events and the end of the one before, so blocks are checked before they play
+	ReplayDecoder decoder;
+	alignas(4) uint8_t bytes[REPLAY_MAX_BLOCK_SIZE + ReplayEncoder::MAX_EVENT_SIZE];
+	size_t bytesStart = 0;
+	size_t bytesEnd = 0;
+
+	Iteration chunks[2][CHUNK_SIZE];
+	volatile int chunkLength[2] = {0, 0};
+
+	pros::c::sem_t emptyChunks = nullptr;	// Chunks the background task may fill
+	pros::c::sem_t filledChunks = nullptr;	// Chunks ready for playback
+	pros::c::sem_t finished = nullptr;		// Posted when the background task exits
+
+	int readChunk = 0;
+	int readPosition = 0;
+
+	ReplayPlayhead playhead;		// Lookup state for at()
+	volatile bool running = false;
+	volatile bool stopRequested = false;
+	volatile bool readFailed = false;
+};
+
+enum SaveStatus {
+	SAVE_SUCCESS,
+	SAVE_FAILED_OPEN,
+	SAVE_FAILED_WRITE
+};
+
+/**
+ * A sample of driver input and when it was taken.
+ */
+struct TimedIteration {
+	uint64_t timeUs;	// From pros::micros()
+	Iteration iteration;
+};
+
+/**
+ * The outcome of a recording, reported back by the replay recorder.
+ */
+struct SaveResult {
+	int slot;
+	SaveStatus status;
+	uint32_t count;		// Iterations recorded
+	uint32_t bytes;		// Size of the encoded event stream
+	uint32_t dropped;	// Iterations lost because the SD card fell behind
+};
+
+/**
+ * Records a replay of any length in constant RAM.
+ *
+ * The control loop pushes timestamped samples into a lock-free ring, and a
+ * low priority task resamples them onto an even grid, encodes them and drains
+ * them to the SD card as the recording runs. A late loop holds its last sample
+ * for the ticks it missed, so the replay keeps real time. The control loop
+ * never blocks on SD I/O; if the card falls more than RING_SIZE ticks behind,
+ * iterations are dropped and counted rather than stalling the loop.
+ */
+class ReplayRecorder {
+	public:
+	static constexpr int RING_SIZE = 128;		// About 2.5 seconds of 20ms samples
+	static constexpr int DRAIN_SIZE = 32;		// Iterations to collect before writing
+	static constexpr uint32_t BLOCK_TICKS = 100;	// Longest a block is held back, the most a power cut can lose
+
+	/**
+	 * Creates the command queues and the recorder task. Called once from
+	 * initialize().
+	 */
+	void start();
+
+	/**
+	 * Starts a recording into a replay slot. Does not block.
+	 *
+	 * \param tickMs
+	 *        Milliseconds between iterations in the file, 5 or 10 for a finer
+	 *        recording as long as the loop calling record() keeps up
+	 * \param driver
+	 *        The stick curves the driver is using, stored in the file
+	 *
+	 * \return False if the previous recording is still being saved or the
+	 * recorder is not started
+	 */
+	bool begin(int slot, uint16_t tickMs = 20, const ReplayDriverInfo& driver = {});
+
+	/**
+	 * Adds one sample to the recording. Does not block.
+	 *
+	 * \param timeUs
+	 *        When the sample was taken, from pros::micros()
+	 */
+	void record(const Iteration& iteration, uint64_t timeUs);
+
+	/**
+	 * Ends the recording. The recorder task writes the rest of the ring buffer,
+	 * the trailer and the generation, reads the file back to check it, and
+	 * sends the result to poll(). Recordings go to the older of the slot's two
+	 * files, so the last save is untouched if this one fails or is cut off.
+	 */
+	void finish();
+
+	/**
+	 * True from begin() until the recording has been fully saved.
+	 */
+	bool busy() const;
+
+	/**
+	 * Gets the result of a finished recording without blocking.
+	 *
+	 * \return True if a result was waiting
+	 */
+	bool poll(SaveResult& result);
+
+	private:
+	enum CommandType {
+		COMMAND_BEGIN,
+		COMMAND_FINISH
+	};
+	struct Command {
+		CommandType type;
+		int slot;
+		uint16_t tickMs;
+		ReplayDriverInfo driver;
+	};
+
+	static void recordTask(void* param);
+	void drain(bool all);
+	void resample(const TimedIteration& sample);
+	void encode(const Iteration& iteration);
+	void flush();
+
+	pros::c::queue_t commands = nullptr;
+	pros::c::queue_t results = nullptr;
+	volatile bool recording = false;
+
+	SpscRing<TimedIteration, RING_SIZE> ring;	// Overruns are the iterations dropped
+
+	// Only touched by the recorder task
+	FILE* file = nullptr;
+	int copy = 0;				// Which of the slot's files is being written, see replayCopyPath()
+	uint32_t generation = 0;
+	ReplayEncoder encoder;
+	uint8_t encoded[REPLAY_MAX_BLOCK_SIZE];		// The block being built
+	size_t encodedSize = 0;
+	uint32_t lastBlockTick = 0;
+	uint32_t tickUs = 20000;
+	uint64_t nextTickUs = 0;	// Time of the next iteration on the grid
+	bool haveSample = false;
+	TimedIteration heldSample;	// The latest sample, held until the grid passes the next one
+	bool active = false;
+	SaveResult result;
+};
+
+extern ReplayRecorder replayRecorder;
+
+#endif  // _REPLAY_HPP_
@@ -0,0 +1,232 @@
+#ifndef _REPLAY_CONTROL_HPP_
+#define _REPLAY_CONTROL_HPP_
+
+#include <algorithm>
+#include <cstdint>
+
+#include "drive_curves.hpp"
+#include "hal.hpp"
+#include "replay_format.hpp"
+#include "trajectory.hpp"
+
+// The record and replay state machine on its own, with files and the screen
+// left to an Io policy.
+
+enum Status {
+	STATUS_RECORDING,
+	STATUS_RECORD_COUNTDOWN,
+	STATUS_REPLAYING,
+	STATUS_DRIVING,
+	STATUS_REPLAY_COUTNDOWN
+};
+
+/**
+ * Button presses the control task passes on to the replay task.
+ */
+enum ControlEvent {
+	EVENT_RECORD,	// X, starts the record countdown or stops a recording
+	EVENT_REPLAY,	// A, starts the replay countdown
+	EVENT_RESET,	// opcontrol() started, drop whatever was running before
+	EVENT_SLOT_NEXT,
+	EVENT_SLOT_PREVIOUS,
+	EVENT_SLOT_FIRST
+};
+
+/**
+ * What the driver asked for in one control tick, and where the drive was.
+ */
+struct DriverSample {
+	uint64_t timeUs;		// From hal::micros()
+	Iteration iteration;	// Positions are absolute, in tenths of a degree
+	bool haveDrive;			// Positions and velocities were read, only outside STATUS_DRIVING
+};
+
+/**
+ * Output the replay task wants in place of the driver's while a replay plays.
+ */
+struct ReplayOutput {
+	bool active;
+	int left;
+	int right;
+	int intake;
+	bool goalClamp;
+};
+
+/**
+ * Where the record and replay state machine is.
+ */
+struct ReplayState {
+	Status status;
+	int time;					// Ticks recorded or replayed so far
+	uint32_t countdownEnd;		// hal::millis() when a countdown finishes
+	int slot;					// Replay slot to record into or play, changed with the EVENT_SLOT events
+};
+
+/**
+ * Records the driver into a slot and plays slots back, driven by control
+ * events and one DriverSample per control tick.
+ *
+ * Everything outside the state machine goes through Io, picked at compile
+ * time so the robot build calls straight through. Io has to provide:
+ *
+ * \code
+ * bool recorderBusy();		// A save is still being written
+ * bool beginRecording(int slot, uint16_t tickMs, const ReplayDriverInfo& driver);
+ * void record(const Iteration& iteration, uint64_t timeUs);
+ * void finishRecording();
+ * bool openReplay(int slot);
+ * bool replayHasTrajectory();
+ * bool replayAt(uint64_t timeUs, Iteration& iteration);	// False once the replay has run out
+ * bool replayFailed();
+ * void closeReplay();
+ * void message(const char* text);
+ * void trackingError(const TrajectoryFollower& left, const TrajectoryFollower& right);
+ * \endcode
+ */
+template <typename Io>
+class ReplayControl {
+	public:
+	static constexpr uint32_t COUNTDOWN_MS = 3000;
+
+	explicit ReplayControl(Io& io, uint16_t tickMs = 20) : io(io), tickMs(tickMs) {}
+
+	void setTickMs(uint16_t tickMs) {
+		this->tickMs = tickMs;
+	}
+
+	void handle(ControlEvent event) {
+		switch (event) {
+			case EVENT_RECORD:
+				if (current.status == STATUS_DRIVING && !io.recorderBusy()) {
+					// Start countdown
+					current = {STATUS_RECORD_COUNTDOWN, 0, hal::millis() + COUNTDOWN_MS, current.slot};
+				} else if (current.status == STATUS_RECORDING) {
+					// End recording, the recorder writes out the rest in the background
+					current.status = STATUS_DRIVING;
+					io.finishRecording();
+				}
+				break;
+			case EVENT_REPLAY:
+				if (current.status == STATUS_DRIVING && !io.recorderBusy()) {
+					current = {STATUS_REPLAY_COUTNDOWN, 0, hal::millis() + COUNTDOWN_MS, current.slot};
+				}
+				break;
+			case EVENT_RESET:
+				stop();
+				current.slot = 0;
+				break;
+			case EVENT_SLOT_NEXT:
+				current.slot = std::clamp(current.slot + 1, 0, REPLAY_SLOT_COUNT - 1);
+				break;
+			case EVENT_SLOT_PREVIOUS:
+				current.slot = std::clamp(current.slot - 1, 0, REPLAY_SLOT_COUNT - 1);
+				break;
+			case EVENT_SLOT_FIRST:
+				current.slot = 0;
+				break;
+		}
+	}
+
+	void update(const DriverSample& sample) {
+		const Iteration& driver = sample.iteration;
+		bool countdownDone = int32_t(hal::millis() - current.countdownEnd) >= 0;
+		if (current.status == STATUS_RECORD_COUNTDOWN && countdownDone && sample.haveDrive) {
+			// Start recording
+			current.time = 0;
+			const DriverProfile& profile = activeDriverProfile();
+			ReplayDriverInfo driverInfo = {{profile.curves[0], profile.curves[1], profile.curves[2], profile.curves[3]}};
+			if (io.beginRecording(current.slot, tickMs, driverInfo)) {
+				recordLeftStart = driver.leftPosition;
+				recordRightStart = driver.rightPosition;
+				current.status = STATUS_RECORDING;
+			} else {
+				current.status = STATUS_DRIVING;
+			}
+		} else if (current.status == STATUS_RECORDING) {
+			// Recording ------------
+			Iteration iteration = driver;
+			iteration.leftPosition -= recordLeftStart;
+			iteration.rightPosition -= recordRightStart;
+			io.record(iteration, sample.timeUs);
+			current.time++;
+		} else if (current.status == STATUS_REPLAY_COUTNDOWN && countdownDone && sample.haveDrive) {
+			// Starts replay, from the cache or streamed from disk
+			current.time = 0;
+			if (io.openReplay(current.slot)) {
+				closedLoop = io.replayHasTrajectory();
+				leftFollower.reset(driver.leftPosition / 10.0);
+				rightFollower.reset(driver.rightPosition / 10.0);
+				replayStart = hal::micros();
+				lastReplayUs = 0;
+				current.status = STATUS_REPLAYING;
+			} else {
+				current.status = STATUS_DRIVING;
+				io.message("Failed to open read file");
+			}
+		}
+
+		if (current.status != STATUS_REPLAYING) {
+			replayOutput.active = false;
+			return;
+		}
+		Iteration iteration;
+		uint64_t replayUs = hal::micros() - replayStart;
+		if (io.replayAt(replayUs, iteration)) {
+			// Replaying ------------ looked up by time, so a late loop doesn't shift the replay
+			replayOutput = {true, iteration.left, iteration.right, iteration.intake, iteration.goalClamp};
+			if (closedLoop && sample.haveDrive) {
+				float dt = (replayUs - lastReplayUs) / 1e6f;
+				replayOutput.left = leftFollower.update(iteration.left, iteration.leftPosition, iteration.leftVelocity, driver.leftPosition / 10.0, driver.leftVelocity, dt);
+				replayOutput.right = rightFollower.update(iteration.right, iteration.rightPosition, iteration.rightVelocity, driver.rightPosition / 10.0, driver.rightVelocity, dt);
+			}
+			lastReplayUs = replayUs;
+			current.time++;
+		} else {
+			// End replay, the reader has run out of recorded iterations
+			current.status = STATUS_DRIVING;
+			replayOutput.active = false;
+			if (io.replayFailed()) {
+				io.message("Error reading data from file!");
+			} else if (closedLoop) {
+				io.trackingError(leftFollower, rightFollower);
+			}
+			io.closeReplay();
+		}
+	}
+
+	/**
+	 * Ends whatever is running, keeping what was recorded so far.
+	 */
+	void stop() {
+		if (current.status == STATUS_RECORDING) {
+			io.finishRecording();
+		} else if (current.status == STATUS_REPLAYING) {
+			io.closeReplay();
+		}
+		current = {STATUS_DRIVING, 0, 0, current.slot};
+		replayOutput.active = false;
+	}
+
+	const ReplayState& state() const {
+		return current;
+	}
+
+	const ReplayOutput& output() const {
+		return replayOutput;
+	}
+
+	private:
+	Io& io;
+	uint16_t tickMs;
+	ReplayState current = {STATUS_DRIVING, 0, 0, 0};
+	ReplayOutput replayOutput = {};
+	bool closedLoop = false;
+	TrajectoryFollower leftFollower;
+	TrajectoryFollower rightFollower;
+	uint64_t replayStart = 0;
+	uint64_t lastReplayUs = 0;
+	int32_t recordLeftStart = 0;	// Drive positions when recording started, recorded positions are relative to them
+	int32_t recordRightStart = 0;
+};
+
+#endif  // _REPLAY_CONTROL_HPP_
@@ -0,0 +1,442 @@
+#ifndef _REPLAY_FORMAT_HPP_
+#define _REPLAY_FORMAT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * One tick of recorded driver input, 20ms unless the header says otherwise,
+ * and where the drive was at the time.
+ */
+struct Iteration {
+	int16_t left;
+	int16_t right;
+	int16_t intake;
+	bool goalClamp;
+	// All zero for replays recorded without a trajectory
+	int32_t leftPosition;	// Tenths of a degree since the recording started
+	int32_t rightPosition;
+	int16_t leftVelocity;	// RPM
+	int16_t rightVelocity;
+};
+
+/**
+ * How an iteration was stored before trajectories were recorded. Legacy and
+ * raw replay files are arrays of these.
+ */
+struct RawIteration {
+	int16_t left;
+	int16_t right;
+	int16_t intake;
+	bool goalClamp;
+};
+
+constexpr int REPLAY_SLOT_COUNT = 10;		// replay0 to replay9 on the SD card, each saved to two files in turn
+
+constexpr uint32_t REPLAY_MAGIC = 0x5A4C5052;			// "RPLZ", encoded replays
+constexpr uint32_t REPLAY_MAGIC_RAW = 0x594C5052;		// "RPLY", raw iterations after a count
+constexpr uint16_t REPLAY_VERSION = 6;					// A ReplayGeneration after the trailer
+constexpr uint16_t REPLAY_VERSION_NO_GENERATION = 5;	// Driver info after the header
+constexpr uint16_t REPLAY_VERSION_NO_DRIVER_INFO = 4;	// Blocks with trajectory channels
+constexpr uint16_t REPLAY_VERSION_NO_TRAJECTORY = 3;	// Blocks and a trailer, see ReplayBlockHeader
+constexpr uint16_t REPLAY_VERSION_UNBLOCKED = 2;		// One event stream, with the count and CRC in the header
+constexpr uint32_t REPLAY_TRAILER_MAGIC = 0x444E4552;	// "REND"
+constexpr uint16_t REPLAY_MAX_BLOCK_SIZE = 256;
+constexpr uint32_t REPLAY_COUNT_UNFINISHED = 0xFFFFFFFF;	// Recording was cut off before the header was filled in
+constexpr uint32_t REPLAY_LEGACY_COUNT = 750;			// Old headerless files are always 15 seconds
+constexpr size_t REPLAY_LEGACY_SIZE = REPLAY_LEGACY_COUNT * sizeof(RawIteration);
+
+enum ReplayFormat {
+	REPLAY_FORMAT_INVALID,
+	REPLAY_FORMAT_LEGACY,	// Up to 750 raw iterations with no header
+	REPLAY_FORMAT_RAW,		// RawReplayHeader then raw iterations
+	REPLAY_FORMAT_ENCODED,	// ReplayHeader then an encoded event stream
+	REPLAY_FORMAT_BLOCKS	// ReplayHeader, blocks of events, then a ReplayTrailer
+};
+
+/**
+ * Header of the first variable length files, followed by count raw iterations.
+ */
+struct RawReplayHeader {
+	uint32_t magic;		// REPLAY_MAGIC_RAW
+	uint32_t count;
+};
+
+/**
+ * Header of an encoded replay.
+ *
+ * The payload is a stream of change events. Each event starts with a varint of
+ * (ticks since the previous event << 4 | channel mask), followed by a zigzag
+ * varint delta for each of left, right and intake in the mask. The goal clamp
+ * bit toggles the clamp and carries no data. Values hold between events, so a
+ * replay costs bytes only when the driver changes something.
+ *
+ * Version 4 adds leftPosition, rightPosition, leftVelocity and rightVelocity
+ * as mask bits 4 to 7, and the event header becomes (ticks << 8 | mask).
+ *
+ * Version 5 is version 4 with a ReplayDriverInfo between the header and the
+ * first block.
+ *
+ * Version 6 is version 5 with a ReplayGeneration after the trailer.
+ *
+ * Files from before any header existed start straight with an Iteration. Their
+ * first drive value is within -127..127, so it can never match a magic number.
+ *
+ * Version 3 files are only ever appended to, so a recording cut off at any
+ * point still has a readable prefix. The header is written first with count
+ * set to REPLAY_COUNT_UNFINISHED and payloadSize and crc set to 0, and the
+ * real values go in the trailer.
+ */
+struct ReplayHeader {
+	uint32_t magic;			// REPLAY_MAGIC
+	uint16_t version;		// REPLAY_VERSION
+	uint16_t tickMs;		// Milliseconds between iterations
+	uint32_t count;			// Number of iterations encoded
+	uint32_t payloadSize;	// Bytes of event stream after the header
+	uint32_t crc;			// CRC-32 of the event stream
+};
+static_assert(sizeof(ReplayHeader) == 20, "ReplayHeader is written to disk as is");
+
+/**
+ * Starts each block of events in a version 3 to 6 file. Events never span blocks,
+ * and each block has its own CRC, so a damaged file can be played up to the
+ * first bad block.
+ */
+struct ReplayBlockHeader {
+	uint16_t size;		// Bytes of events after this header
+	uint16_t reserved;	// Always 0
+	uint32_t endTick;	// Iterations covered by this and every earlier block
+	uint32_t crc;		// CRC-32 of endTick then the events
+};
+static_assert(sizeof(ReplayBlockHeader) == 12, "ReplayBlockHeader is written to disk as is");
+
+/**
+ * Ends the blocks of a complete version 3 to 6 file. Its first word can never
+ * be mistaken for a block header, since blocks are at most
+ * REPLAY_MAX_BLOCK_SIZE bytes.
+ */
+struct ReplayTrailer {
+	uint32_t magic;			// REPLAY_TRAILER_MAGIC
+	uint32_t count;			// Number of iterations encoded
+	uint32_t payloadSize;	// Bytes of events in all blocks, not counting block headers
+	uint32_t crc;			// CRC-32 of the events in all blocks
+};
+static_assert(sizeof(ReplayTrailer) == 16, "ReplayTrailer is written to disk as is");
+
+/**
+ * Follows the trailer of a complete version 6 file.
+ *
+ * A slot is saved to two files in turn, always over the older one, and the
+ * file with the higher generation is the newer save. The SD card has no
+ * rename or delete, so this is what makes a save atomic: the file being
+ * written only counts once its generation is on the card, and until then the
+ * other file still holds the last good save.
+ */
+struct ReplayGeneration {
+	uint32_t generation;	// One more than the slot's newest save when this one started
+	uint32_t crc;			// CRC-32 of the trailer then generation
+};
+static_assert(sizeof(ReplayGeneration) == 8, "ReplayGeneration is written to disk as is");
+
+/**
+ * How the driver's sticks were set up for a recording, after the header of a
+ * version 5 file. Older files are taken to be all linear, which is how they
+ * were driven.
+ */
+struct ReplayDriverInfo {
+	uint8_t curves[4];		// DriveCurve of each stick axis, in Axis order
+};
+static_assert(sizeof(ReplayDriverInfo) == 4, "ReplayDriverInfo is written to disk as is");
+static_assert(sizeof(RawIteration) == 8, "Legacy replays are 8 bytes per iteration");
+
+/**
+ * What a replay file holds, worked out from its first bytes.
+ */
+struct ReplayInfo {
+	ReplayFormat format;
+	uint32_t count;			// Iterations in the replay
+	size_t dataOffset;		// Where the iterations or event stream start
+	uint32_t payloadSize;	// Encoded replays only
+	uint32_t crc;			// Encoded replays only
+	uint16_t tickMs;
+	uint8_t channels;		// 8 if the events include the trajectory, otherwise 4
+	ReplayDriverInfo driver;
+	uint32_t generation;	// Complete version 6 files only, otherwise 0
+};
+
+/**
+ * Works out the format of a replay from the start of the file.
+ *
+ * \param data
+ *        The first bytes of the file, at least sizeof(ReplayHeader) if the
+ *        file is that long. The driver info of a version 5 or 6 file is only
+ *        filled in if its bytes are there too.
+ * \param fileSize
+ *        Size of the whole file, so legacy files can be checked
+ */
+ReplayInfo replayDetectFormat(const uint8_t* data, size_t size, size_t fileSize);
+
+/**
+ * Continues a CRC-32 (the zlib polynomial). Start with crc = 0.
+ */
+uint32_t replayCrc32(uint32_t crc, const uint8_t* data, size_t size);
+
+/**
+ * Builds the header for a block of events.
+ */
+ReplayBlockHeader replayMakeBlock(const uint8_t* events, uint16_t size, uint32_t endTick);
+
+/**
+ * Builds the generation to write after a version 6 file's trailer.
+ */
+ReplayGeneration replayMakeGeneration(const ReplayTrailer& trailer, uint32_t generation);
+
+/**
+ * The most of a file's end replayFileGeneration() and replayReadTrailer() need.
+ */
+constexpr size_t REPLAY_END_SIZE = sizeof(ReplayTrailer) + sizeof(ReplayGeneration);
+
+/**
+ * Gets a file's generation from only its first and last bytes, so the newer of
+ * a slot's two files can be picked without reading either whole.
+ *
+ * \param head
+ *        The first sizeof(ReplayHeader) bytes of the file, fewer if it is shorter
+ * \param tail
+ *        The last REPLAY_END_SIZE bytes of the file, fewer if it is shorter
+ *
+ * \return False if the file is empty or is a version 6 file that was cut off
+ * before it was finished. Every older format counts as generation 0.
+ */
+bool replayFileGeneration(const uint8_t* head, size_t headSize, const uint8_t* tail, size_t tailSize, uint32_t& generation);
+
+/**
+ * Gets the trailer of a finished version 3 to 6 file from its first and last
+ * bytes, so its blocks can be streamed knowing the count and CRC up front.
+ * Takes the same head and tail as replayFileGeneration().
+ *
+ * \param generation
+ *        Set to the file's generation, 0 before version 6
+ *
+ * \return False if the file is not blocked or was cut off before it was finished
+ */
+bool replayReadTrailer(const uint8_t* head, size_t headSize, const uint8_t* tail, size_t tailSize, ReplayTrailer& trailer, uint32_t& generation);
+
+/**
+ * Joins the events in a whole version 3 to 6 file into one stream for
+ * ReplayDecoder. Stops at the first damaged block, so a cut off or corrupt
+ * file still gives back everything before it.
+ *
+ * \param info
+ *        Filled in as an encoded replay of the events that were recovered
+ *
+ * \return True if the file was complete and matched its trailer, and for
+ * version 6 its generation
+ */
+bool replayUnpackBlocks(const uint8_t* data, size_t size, std::vector<uint8_t>& events, ReplayInfo& info);
+
+/**
+ * Reads and validates a whole replay file of any format. Every format comes
+ * out as an encoded event stream, so they are all played back the same way.
+ * This is what both the robot and the host tools load replays with.
+ *
+ * \param payload
+ *        Filled with the event stream
+ * \param info
+ *        Filled in as an encoded replay with dataOffset 0
+ * \param recovered
+ *        Set if only the part before a damaged block could be read
+ *
+ * \return False if nothing in the file is valid
+ */
+bool replayParse(const uint8_t* data, size_t size, std::vector<uint8_t>& payload, ReplayInfo& info, bool& recovered);
+
+/**
+ * Converts an iteration from a legacy or raw replay, which has no trajectory.
+ */
+Iteration replayFromRaw(const RawIteration& raw);
+
+/**
+ * Blends two neighbouring iterations for playback between them. The drive
+ * and trajectory values are interpolated, the intake and goal clamp hold the
+ * earlier value.
+ *
+ * \param fraction
+ *        How far from a to b, 0 to 1
+ */
+Iteration replayInterpolate(const Iteration& a, const Iteration& b, float fraction);
+
+/**
+ * Looks a replay up by time since it started, stepping through its
+ * iterations in order and blending the two either side. ReplayReader::at()
+ * plays through this, and so does the host simulator.
+ */
+class ReplayPlayhead {
+	public:
+	/**
+	 * Goes back to the start, for a replay that has not been read from yet.
+	 */
+	void reset() {
+		started = false;
+	}
+
+	/**
+	 * Gets what the replay was doing elapsedUs after it started. The time must
+	 * never go back.
+	 *
+	 * \param next
+	 *        Called as bool next(Iteration&) for each iteration in order, false
+	 *        once there are no more
+	 *
+	 * \return False once the time is past the end of the replay
+	 */
+	template <typename Next>
+	bool at(uint64_t elapsedUs, uint16_t tickMs, Iteration& iteration, Next&& next) {
+		if (!started) {
+			if (!next(current)) {
+				return false;
+			}
+			haveFollowing = next(following);
+			currentIndex = 0;
+			started = true;
+		}
+
+		uint32_t tickUs = tickMs * 1000;
+		uint64_t index = elapsedUs / tickUs;
+		while (currentIndex < index) {
+			if (!haveFollowing) {
+				return false;		// Past the last iteration
+			}
+			current = following;
+			currentIndex++;
+			haveFollowing = next(following);
+		}
+
+		float fraction = float(elapsedUs - index * tickUs) / tickUs;
+		iteration = haveFollowing ? replayInterpolate(current, following, fraction) : current;
+		return true;
+	}
+
+	private:
+	// The iteration at currentIndex and the one after it
+	bool started = false;
+	bool haveFollowing = false;
+	uint64_t currentIndex = 0;
+	Iteration current;
+	Iteration following;
+};
+
+/**
+ * Turns iterations into the encoded event stream one at a time, so recordings
+ * can be written out as they happen.
+ */
+class ReplayEncoder {
+	public:
+	static constexpr size_t MAX_EVENT_SIZE = 5 + 5 * 3 + 2 * 5;		// Longest possible bytes for one iteration
+
+	/**
+	 * Starts a new replay.
+	 *
+	 * \param tickMs
+	 *        Milliseconds between the iterations that will be added
+	 * \param trajectory
+	 *        False to leave the trajectory out, for iterations that have none
+	 * \param driver
+	 *        Stored after the header of replays with a trajectory
+	 */
+	void reset(uint16_t tickMs = 20, bool trajectory = true, const ReplayDriverInfo& driver = {});
+
+	/**
+	 * Encodes the next iteration.
+	 *
+	 * \param out
+	 *        Space for at least MAX_EVENT_SIZE bytes
+	 *
+	 * \return Bytes written to out, 0 if nothing changed this tick
+	 */
+	size_t add(const Iteration& iteration, uint8_t* out);
+
+	/**
+	 * Number of iterations added since reset().
+	 */
+	uint32_t count() const;
+
+	/**
+	 * Builds the header for everything added since reset().
+	 */
+	ReplayHeader header() const;
+
+	/**
+	 * Gets the driver info to write straight after the header, if header()
+	 * is REPLAY_VERSION. The generation to write after the trailer comes from
+	 * replayMakeGeneration().
+	 */
+	ReplayDriverInfo driverInfo() const;
+
+	/**
+	 * Builds the trailer for everything added since reset().
+	 */
+	ReplayTrailer trailer() const;
+
+	private:
+	Iteration last;
+	uint16_t tickMs;
+	uint8_t channels;
+	ReplayDriverInfo driver;
+	uint32_t iterations;
+	uint32_t lastEventTick;
+	uint32_t payloadSize;
+	uint32_t crc;
+};
+
+enum DecodeResult {
+	DECODE_OK,
+	DECODE_END,				// All iterations have been returned
+	DECODE_NEED_BYTES,		// The next event is not all in the buffer yet, nothing was consumed
+	DECODE_ERROR			// The event stream is corrupt
+};
+
+/**
+ * Turns an encoded event stream back into iterations. Bytes are passed in as
+ * they are read, so the whole stream never has to be in memory.
+ */
+class ReplayDecoder {
+	public:
+	void reset(const ReplayInfo& info);
+
+	/**
+	 * Decodes the next iteration.
+	 *
+	 * \param data
+	 *        Read position in the event stream, moved past anything consumed
+	 * \param end
+	 *        End of the bytes currently available
+	 */
+	DecodeResult next(Iteration& iteration, const uint8_t*& data, const uint8_t* end);
+
+	/**
+	 * True once every iteration is out and the stream matched its CRC.
+	 */
+	bool verified() const;
+
+	private:
+	struct Event {
+		uint8_t mask;
+		int32_t deltas[8];		// Indexed by channel, the goal clamp's is unused
+	};
+
+	Iteration current;
+	Event pending;
+	bool havePending;
+	uint8_t channels;
+	uint32_t tick;
+	uint32_t count;
+	uint32_t nextEventTick;
+	uint32_t lastEventTick;
+	uint32_t payloadLeft;
+	uint32_t expectedCrc;
+	uint32_t crc;
+};
+
+#endif  // _REPLAY_FORMAT_HPP_
@@ -0,0 +1,185 @@
+#ifndef _ROBOT_TASKS_HPP_
+#define _ROBOT_TASKS_HPP_
+
+#include <cstdint>
+#include <string>
+
+#include "actuators.hpp"
+#include "drive_control.hpp"
+#include "loop_stats.hpp"
+#include "pros/apix.h"
+#include "replay.hpp"
+#include "replay_control.hpp"
+#include "seqlock.hpp"
+#include "spsc_ring.hpp"
+#include "trajectory.hpp"
+
+// Operator control runs as three tasks, so nothing slow can hold up the motors:
+//   Control, high priority: opcontrol() itself. Reads the controller, works out
+//     the drive output and writes the motors every tick.
+//   Replay, medium priority: the record and replay state machine, the recorder
+//     and telemetry, and closed loop playback.
+//   UI, low priority: the LCD lines and controller text and rumbles.
+// The control task never waits on the other two. It only pushes to lock-free
+// rings and non-blocking queues and reads the latest values out of seqlocks.
+constexpr uint32_t CONTROL_TASK_PRIORITY = TASK_PRIORITY_DEFAULT + 2;
+constexpr uint32_t REPLAY_TASK_PRIORITY = TASK_PRIORITY_DEFAULT + 1;	// Above the replay reader's fill task
+constexpr uint32_t UI_TASK_PRIORITY = TASK_PRIORITY_MIN + 1;
+
+// The control loop's period, which is also the rate replays are recorded at.
+// Set to 10 or 5 to record at a higher rate.
+constexpr uint16_t CONTROL_TICK_MS = 20;
+
+/**
+ * Gets the text shown when the replay slot changes, marking slots with no
+ * valid replay in the cache.
+ *
+ * \param brief
+ *        Gives the short form that fits on a controller line, "Slot N empty"
+ */
+std::string replaySlotText(int slot, bool brief = false);
+
+/**
+ * Shows how closely a closed loop replay tracked its recording.
+ */
+void showTrackingError(const TrajectoryFollower& left, const TrajectoryFollower& right);
+
+/**
+ * Shows a loop timing report on line 4.
+ */
+void showLoopReport(const LoopReport& report);
+
+/**
+ * Shows how many actuator writes the control task made and saved on line 6.
+ */
+void showActuatorStats(const ActuatorStats& stats);
+
+/**
+ * Everything about operator control in one consistent snapshot, published by
+ * the control task at the end of every tick for the UI and anything else that
+ * wants to watch.
+ */
+struct RobotState {
+	uint32_t tickMs;		// pros::millis() of the tick, 0 before the first
+	DriveMode driveMode;
+	Status status;
+	int slot;
+	int time;
+	uint32_t countdownEnd;
+	int left;				// Drive output of the tick, 0 inside the deadzone
+	int right;
+	int intake;
+	bool goalClamp;
+};
+
+/**
+ * Everything the operator control tasks share.
+ */
+struct RobotChannels {
+	static constexpr size_t SAMPLE_RING_SIZE = 8;
+	static constexpr int EVENT_QUEUE_SIZE = 8;
+
+	// Each seqlock has exactly one writer. The control task outranks the
+	// replay task, so it reads the replay task's seqlocks with tryRead().
+	SpscRing<DriverSample, SAMPLE_RING_SIZE> samples;		// Control to replay, every tick
+	pros::task_t sampleReader = nullptr;	// Notified after each sample
+	pros::c::queue_t events = nullptr;		// ControlEvent, control and LLEMU buttons to replay
+	Seqlock<ReplayOutput> replayOutput;		// Replay to control
+	Seqlock<ReplayState> replayState;		// Replay to everyone, the only source of the replay slot
+	Seqlock<RobotState> robotState;			// Control to everyone
+	Seqlock<LoopReport> loopReport;			// Control to UI
+	Seqlock<ActuatorStats> actuatorStats;	// Control to UI, with each loop report
+
+	/**
+	 * Creates the event queue. Called once from initialize().
+	 */
+	void start();
+
+	/**
+	 * Sends an event to the replay task without blocking. Does nothing before
+	 * start().
+	 */
+	void send(ControlEvent event);
+
+	/**
+	 * Hands a sample to the replay task without blocking. A sample is dropped
+	 * and counted in samples.overruns() if the replay task is stuck; the ones
+	 * dropped while recording are shown with the save.
+	 */
+	void sendSample(const DriverSample& sample);
+};
+
+extern RobotChannels channels;
+
+/**
+ * Runs recording and playback for operator control.
+ *
+ * Woken by every sample the control task sends, so playback output is ready
+ * for the control task's next tick. Recording, telemetry and opening replays
+ * all happen here, so none of them can delay a motor update.
+ */
+class ReplayTask {
+	public:
+	/**
+	 * Starts the task. Called once from initialize(), after channels.start().
+	 */
+	void start(uint16_t tickMs = CONTROL_TICK_MS);
+
+	private:
+	/**
+	 * Hands the state machine's files and messages to the recorders, the
+	 * replay reader and the LCD.
+	 */
+	struct Io {
+		bool recorderBusy();
+		bool beginRecording(int slot, uint16_t tickMs, const ReplayDriverInfo& driver);
+		void record(const Iteration& iteration, uint64_t timeUs);
+		void finishRecording();
+		bool openReplay(int slot);
+		bool replayHasTrajectory();
+		bool replayAt(uint64_t timeUs, Iteration& iteration);
+		bool replayFailed();
+		void closeReplay();
+		void message(const char* text);
+		void trackingError(const TrajectoryFollower& left, const TrajectoryFollower& right);
+
+		ReplayReader reader;	// A member so the chunk buffers stay off the task stack
+		uint32_t recordingOverruns = 0;		// channels.samples.overruns() when recording began
+		uint32_t missedSamples = 0;			// Samples the last recording never got
+	};
+
+	static void run(void* param);
+	void publish();
+	void pollSaves();
+
+	uint16_t tickMs = 20;
+	bool started = false;
+	Io io;
+	ReplayControl<Io> control{io};
+};
+
+extern ReplayTask replayTask;
+
+/**
+ * Draws operator control's state onto the LCD and controller at a low rate.
+ * Stays quiet unless opcontrol() is running, so it never covers what the
+ * other competition modes show.
+ */
+class UiTask {
+	public:
+	static constexpr uint32_t PERIOD_MS = 50;
+
+	/**
+	 * Starts the task. Called once from initialize(), after channels.start().
+	 */
+	void start();
+
+	private:
+	static void run(void* param);
+
+	bool started = false;
+};
+
+extern UiTask uiTask;
+
+#endif  // _ROBOT_TASKS_HPP_
@@ -0,0 +1,72 @@
+#ifndef _SCHEDULER_HPP_
+#define _SCHEDULER_HPP_
+
+#include <cstdint>
+
+/**
+ * What a PeriodicScheduler does when a loop runs past its deadline.
+ */
+enum OverrunPolicy {
+	OVERRUN_SKIP,		// Runs the late tick straight away, drops any whole periods missed and stays on the grid
+	OVERRUN_CATCH_UP,	// Runs every missed tick back to back until it is back on the grid
+	OVERRUN_RESET		// Runs the late tick straight away and starts a new grid from it
+};
+
+/**
+ * Paces a loop at a fixed rate with task_delay_until, so the period is the
+ * same no matter how long the loop body takes. pros::delay() after the work
+ * makes the real period the delay plus the work, which drifts.
+ *
+ * \code
+ * PeriodicScheduler scheduler(20);
+ * scheduler.start();
+ * while (true) {
+ *     // Work
+ *     scheduler.wait();
+ * }
+ * \endcode
+ */
+class PeriodicScheduler {
+	public:
+	explicit PeriodicScheduler(uint32_t periodMs = 20, OverrunPolicy policy = OVERRUN_SKIP);
+
+	/**
+	 * Starts the grid at the current time and clears the counters.
+	 */
+	void start();
+
+	/**
+	 * Waits for the next tick on the grid. Returns straight away if the
+	 * deadline has already passed, following the overrun policy.
+	 *
+	 * \return Whole periods skipped to get back on the grid, 0 if on time
+	 */
+	uint32_t wait();
+
+	uint32_t period() const;
+
+	/**
+	 * Ticks since start().
+	 */
+	uint32_t ticks() const;
+
+	/**
+	 * Times wait() was called after its deadline had passed.
+	 */
+	uint32_t overruns() const;
+
+	/**
+	 * Whole periods dropped by OVERRUN_SKIP or OVERRUN_RESET.
+	 */
+	uint32_t skipped() const;
+
+	private:
+	uint32_t periodMs;
+	OverrunPolicy policy;
+	uint32_t lastWake = 0;		// Grid time of the current tick, from pros::millis()
+	uint32_t tickCount = 0;
+	uint32_t overrunCount = 0;
+	uint32_t skippedCount = 0;
+};
+
+#endif  // _SCHEDULER_HPP_
@@ -0,0 +1,95 @@
+#ifndef _SEQLOCK_HPP_
+#define _SEQLOCK_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Publishes the latest value of a small struct from one writer task to any
+ * number of readers, without locks.
+ *
+ * The writer never waits: it bumps the sequence to odd, stores the value and
+ * bumps it back to even. A reader copies the value and retries if the
+ * sequence was odd or changed while it copied, so it always gets a whole
+ * snapshot from a single write. The value is held as atomic words, so a copy
+ * racing a write is a retry and never undefined behaviour.
+ *
+ * Only one task may ever call write() on a given Seqlock.
+ */
+template <typename T>
+class Seqlock {
+	static_assert(std::is_trivially_copyable<T>::value, "Seqlock copies values word by word");
+
+	public:
+	Seqlock() {
+		write(T{});
+	}
+
+	/**
+	 * Publishes a new value. Writer only, never blocks.
+	 */
+	void write(const T& value) {
+		uint32_t buffer[WORDS] = {};
+		std::memcpy(buffer, &value, sizeof(T));
+		uint32_t start = sequence.load(std::memory_order_relaxed);
+		sequence.store(start + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < WORDS; i++) {
+			words[i].store(buffer[i], std::memory_order_relaxed);
+		}
+		sequence.store(start + 2, std::memory_order_release);
+	}
+
+	/**
+	 * Copies out the latest value, once without retrying.
+	 *
+	 * \return False if a write was in progress, in which case value is untouched
+	 */
+	bool tryRead(T& value) const {
+		uint32_t start = sequence.load(std::memory_order_acquire);
+		if (start & 1) {
+			return false;
+		}
+		uint32_t buffer[WORDS];
+		for (size_t i = 0; i < WORDS; i++) {
+			buffer[i] = words[i].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sequence.load(std::memory_order_relaxed) != start) {
+			return false;
+		}
+		std::memcpy(&value, buffer, sizeof(T));
+		return true;
+	}
+
+	/**
+	 * Copies out the latest value, retrying until a write is not in the way.
+	 * Only for readers at or below the writer's priority. A higher priority
+	 * reader that interrupted a write would spin forever, so it has to use
+	 * tryRead() and keep its last copy instead.
+	 */
+	T read() const {
+		T value;
+		while (!tryRead(value)) {
+		}
+		return value;
+	}
+
+	/**
+	 * Changes with every write, so a reader can tell whether anything new has
+	 * been published since it last looked.
+	 */
+	uint32_t version() const {
+		return sequence.load(std::memory_order_acquire) / 2;
+	}
+
+	private:
+	static constexpr size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+	std::atomic<uint32_t> sequence{0};
+	std::atomic<uint32_t> words[WORDS];
+};
+
+#endif  // _SEQLOCK_HPP_
@@ -0,0 +1,153 @@
+#ifndef _SPSC_RING_HPP_
+#define _SPSC_RING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A fixed size queue between exactly one producer task and one consumer task,
+ * with no locks and no kernel calls.
+ *
+ * Items are stored inline. The producer only ever writes head and the consumer
+ * only ever writes tail, each published with a release store, so neither side
+ * can block the other. When the ring is full push() drops the new item and
+ * counts an overrun instead of waiting, which is what a control loop wants.
+ *
+ * \code
+ * // Producer
+ * ring.push(sample);
+ * // Consumer, in place and in batches
+ * const Sample* items;
+ * while (size_t count = ring.front(items)) {
+ *     for (size_t i = 0; i < count; i++) {
+ *         use(items[i]);
+ *     }
+ *     ring.consume(count);
+ * }
+ * \endcode
+ *
+ * \tparam T
+ *         Item type, copied in and out with operator=
+ * \tparam N
+ *         Capacity, a power of two
+ */
+template <typename T, size_t N>
+class SpscRing {
+	static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+	static_assert(N <= 0x80000000u, "SpscRing indexes wrap at 32 bits");
+
+	public:
+	static constexpr size_t CAPACITY = N;
+
+	/**
+	 * Adds an item. Producer only.
+	 *
+	 * \return False if the ring was full, in which case the item is dropped
+	 *         and counted in overruns()
+	 */
+	bool push(const T& item) {
+		uint32_t position = head.load(std::memory_order_relaxed);
+		if (position - tail.load(std::memory_order_acquire) >= N) {
+			overrunCount.store(overrunCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return false;
+		}
+		items[position & MASK] = item;
+		head.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Removes the oldest item. Consumer only.
+	 *
+	 * \return False if the ring was empty
+	 */
+	bool pop(T& item) {
+		uint32_t position = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) == position) {
+			return false;
+		}
+		item = items[position & MASK];
+		tail.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Copies out up to max of the oldest items in one go. Consumer only.
+	 *
+	 * \return Number of items copied
+	 */
+	size_t pop(T* out, size_t max) {
+		size_t total = 0;
+		const T* batch;
+		while (total < max) {
+			size_t count = front(batch);
+			if (count == 0) {
+				break;
+			}
+			if (count > max - total) {
+				count = max - total;
+			}
+			for (size_t i = 0; i < count; i++) {
+				out[total + i] = batch[i];
+			}
+			consume(count);
+			total += count;
+		}
+		return total;
+	}
+
+	/**
+	 * Gets the oldest items without copying them, up to the end of the storage
+	 * if they wrap around. Consumer only. The items stay valid until consume().
+	 *
+	 * \return Number of items at batch, 0 if the ring is empty
+	 */
+	size_t front(const T*& batch) const {
+		uint32_t position = tail.load(std::memory_order_relaxed);
+		uint32_t available = head.load(std::memory_order_acquire) - position;
+		uint32_t start = position & MASK;
+		batch = &items[start];
+		return available < N - start ? available : N - start;
+	}
+
+	/**
+	 * Releases items returned by front(). Consumer only.
+	 */
+	void consume(size_t count) {
+		tail.store(tail.load(std::memory_order_relaxed) + uint32_t(count), std::memory_order_release);
+	}
+
+	/**
+	 * Items waiting to be read. The other side may change it straight after,
+	 * so from the consumer it can only grow and from the producer only shrink.
+	 */
+	size_t size() const {
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * Items dropped because the ring was full.
+	 */
+	uint32_t overruns() const {
+		return overrunCount.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Zeroes overruns(). Producer only.
+	 */
+	void clearOverruns() {
+		overrunCount.store(0, std::memory_order_relaxed);
+	}
+
+	private:
+	static constexpr uint32_t MASK = N - 1;
+
+	// Kept on separate cache lines so the two sides don't keep stealing the line from each other
+	alignas(64) std::atomic<uint32_t> head{0};		// Only written by the producer
+	std::atomic<uint32_t> overrunCount{0};
+	alignas(64) std::atomic<uint32_t> tail{0};		// Only written by the consumer
+	alignas(64) T items[N];
+};
+
+#endif  // _SPSC_RING_HPP_
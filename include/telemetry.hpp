@@ -0,0 +1,128 @@
+#ifndef _TELEMETRY_HPP_
+#define _TELEMETRY_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "pros/apix.h"
+#include "pros/motor_group.hpp"
+#include "telemetry_format.hpp"
+
+/**
+ * Records everything the motors, ADI ports and battery report while a replay is
+ * being recorded, into a column per signal file next to the replay.
+ *
+ * Sampling runs in its own task on a fixed period, so the control loop only
+ * calls begin() and finish(). Rows are gathered into a batch in memory and a
+ * low priority task writes whole batches to the SD card while the next one
+ * fills. If the card falls a whole batch behind, rows are dropped and counted
+ * rather than holding up sampling.
+ */
+class TelemetryRecorder {
+	public:
+	static constexpr int BATCH_SIZE = 50;		// One second of 20ms rows
+	static constexpr int MAX_COLUMNS = 64;
+
+	/**
+	 * Adds current, temperature, voltage, velocity and position columns for each
+	 * motor in a group. Call before start().
+	 *
+	 * \param name
+	 *        Short name for the group, the motor number is added after it
+	 */
+	void addMotors(const char* name, const std::vector<int8_t>& ports);
+
+	/**
+	 * Adds a column for the value of an ADI port. Call before start().
+	 */
+	void addAdiPort(const char* name, uint8_t port);
+
+	/**
+	 * Creates the sampling and writer tasks. Called once from initialize().
+	 */
+	void start();
+
+	/**
+	 * Starts recording telemetry for a replay slot. Does not block.
+	 *
+	 * \return False if the last recording is still being written or the
+	 * recorder is not started
+	 */
+	bool begin(int slot, uint16_t tickMs = 20);
+
+	/**
+	 * Ends the recording. The writer task writes out the last batch and closes
+	 * the file.
+	 */
+	void finish();
+
+	/**
+	 * True from begin() until the file has been closed.
+	 */
+	bool busy() const;
+
+	/**
+	 * Rows lost in the current or last recording because the SD card fell behind.
+	 */
+	uint32_t dropped() const;
+
+	/**
+	 * True if the last recording could not be opened or written.
+	 */
+	bool failed() const;
+
+	private:
+	enum CommandType {
+		COMMAND_BEGIN,
+		COMMAND_FINISH
+	};
+	struct Command {
+		CommandType type;
+		int slot;
+		uint16_t tickMs;
+	};
+	struct Batch {
+		int32_t values[MAX_COLUMNS][BATCH_SIZE];	// Column major, written a column at a time
+		uint16_t count;
+		int slot;
+		uint16_t tickMs;
+		bool first;		// Opens the file before writing
+		bool last;		// Closes the file after writing
+	};
+	struct MotorSource {
+		std::unique_ptr<pros::MotorGroup> group;	// MotorGroup can't be moved, so it lives on the heap
+		size_t count;
+		int firstColumn;	// Five columns per motor from here
+	};
+	struct AdiSource {
+		uint8_t port;
+		int column;
+	};
+
+	static void sampleTask(void* param);
+	static void writeTask(void* param);
+	void sample(Batch& batch, uint32_t elapsedMs);
+	bool write(const Batch& batch);
+	void addColumn(const std::string& name);
+
+	std::vector<std::string> columns = {"time ms", "battery mV", "battery mA"};
+	std::vector<MotorSource> motors;
+	std::vector<AdiSource> adiPorts;
+
+	pros::c::queue_t commands = nullptr;
+	pros::c::sem_t emptyBatches = nullptr;		// Batches the sampling task may fill
+	pros::c::sem_t filledBatches = nullptr;		// Batches ready for the writer task
+	Batch batches[2];
+	volatile bool recording = false;
+	volatile uint32_t droppedRows = 0;
+	volatile bool writeFailed = false;
+
+	FILE* file = nullptr;		// Only touched by the writer task
+};
+
+extern TelemetryRecorder telemetryRecorder;
+
+#endif  // _TELEMETRY_HPP_
@@ -0,0 +1,52 @@
+#ifndef _TELEMETRY_FORMAT_HPP_
+#define _TELEMETRY_FORMAT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint32_t TELEMETRY_MAGIC = 0x4D4C4554;			// "TELM"
+constexpr uint32_t TELEMETRY_BATCH_MAGIC = 0x48435442;		// "BTCH"
+constexpr uint16_t TELEMETRY_VERSION = 1;
+constexpr size_t TELEMETRY_NAME_SIZE = 24;
+
+/**
+ * Start of a telemetry file, recorded next to a replay as replayN.tlm.
+ *
+ * The header is followed by columnCount TelemetryColumn names and then
+ * batches. Each batch is a TelemetryBatchHeader and count int32_t values of the
+ * first column, then count values of the second, and so on. Keeping every
+ * signal in its own run means a tool looking at one signal reads only that
+ * column of each batch and seeks past the rest.
+ *
+ * Column 0 is always the milliseconds since the recording started, so rows can
+ * be matched up with replay ticks.
+ */
+struct TelemetryHeader {
+	uint32_t magic;			// TELEMETRY_MAGIC
+	uint16_t version;		// TELEMETRY_VERSION
+	uint16_t tickMs;		// Milliseconds between rows
+	uint16_t columnCount;
+	uint16_t batchSize;		// Rows in every batch but the last
+};
+static_assert(sizeof(TelemetryHeader) == 12, "TelemetryHeader is written to disk as is");
+
+/**
+ * Names a column, with its units, like "left 1 current mA".
+ */
+struct TelemetryColumn {
+	char name[TELEMETRY_NAME_SIZE];		// Zero padded, not always terminated
+};
+
+/**
+ * Starts each batch of rows. A batch with a bad CRC can be skipped, since
+ * its size is known from count and the header.
+ */
+struct TelemetryBatchHeader {
+	uint32_t magic;		// TELEMETRY_BATCH_MAGIC
+	uint16_t count;		// Rows in this batch
+	uint16_t reserved;	// Always 0
+	uint32_t crc;		// replayCrc32 of the values in this batch
+};
+static_assert(sizeof(TelemetryBatchHeader) == 12, "TelemetryBatchHeader is written to disk as is");
+
+#endif  // _TELEMETRY_FORMAT_HPP_
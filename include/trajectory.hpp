@@ -0,0 +1,76 @@
+#ifndef _TRAJECTORY_HPP_
+#define _TRAJECTORY_HPP_
+
+#include <cstdint>
+
+/**
+ * Gains for following a recorded trajectory. Errors are in degrees and RPM,
+ * outputs in motor units of -127 to 127.
+ */
+struct TrajectoryGains {
+	float kP;				// Per degree of position error
+	float kI;				// Per degree second of position error
+	float kD;				// Per RPM of velocity error
+	float integralLimit;	// Most the integral term can add, in motor units
+};
+
+constexpr TrajectoryGains TRAJECTORY_DEFAULT_GAINS = {0.4f, 0.2f, 0.1f, 20.0f};
+
+/**
+ * Drives one side of the drivetrain along the positions and velocities of a
+ * recording.
+ *
+ * The recorded stick value is kept as the feedforward, so a replay that is on
+ * track plays exactly as it was driven. PID on the position error and a
+ * velocity term on top correct for a low battery, wheel slip or a different
+ * field, which open loop playback lets build up over the whole run.
+ */
+class TrajectoryFollower {
+	public:
+	explicit TrajectoryFollower(TrajectoryGains gains = TRAJECTORY_DEFAULT_GAINS);
+
+	/**
+	 * Starts following from the top of a replay.
+	 *
+	 * \param startPosition
+	 *        Where the motors are now in degrees, which recorded position 0 is
+	 *        taken to be
+	 */
+	void reset(double startPosition);
+
+	/**
+	 * Works out the motor output for one loop.
+	 *
+	 * \param command
+	 *        The recorded stick value
+	 * \param recordedPosition
+	 *        Where the recording was, in tenths of a degree
+	 * \param recordedVelocity
+	 *        How fast the recording was going, in RPM
+	 * \param dtSeconds
+	 *        Time since the last update
+	 *
+	 * \return The motor output, -127 to 127
+	 */
+	int update(int16_t command, int32_t recordedPosition, int16_t recordedVelocity,
+	           double actualPosition, double actualVelocity, float dtSeconds);
+
+	/**
+	 * Position error at the last update, in degrees.
+	 */
+	float error() const;
+
+	/**
+	 * Largest position error since reset(), in degrees.
+	 */
+	float maxError() const;
+
+	private:
+	TrajectoryGains gains;
+	double startPosition = 0;
+	float integral = 0;
+	float lastError = 0;
+	float largestError = 0;
+};
+
+#endif  // _TRAJECTORY_HPP_
@@ -0,0 +1,52 @@
+#include "actuators.hpp"
+
+MotorOutput::MotorOutput(const hal::MotorGroup& motor, ActuatorStats& stats)
+    : motor(motor), stats(stats), ports(motor.size()) {}
+
+void MotorOutput::move(int32_t power) {
+	if (due(COMMAND_MOVE, power)) {
+		motor.move(power);
+	}
+}
+
+void MotorOutput::brake() {
+	if (due(COMMAND_BRAKE, 0)) {
+		motor.brake();
+	}
+}
+
+void MotorOutput::invalidate() {
+	lastCommand = COMMAND_NONE;
+}
+
+bool MotorOutput::due(Command command, int32_t power) {
+	uint32_t now = hal::millis();
+	if (command == lastCommand && power == lastPower && now - sentMs < KEEP_ALIVE_MS) {
+		stats.saved += ports;
+		return false;
+	}
+	lastCommand = command;
+	lastPower = power;
+	sentMs = now;
+	stats.sent += ports;
+	return true;
+}
+
+DigitalOutput::DigitalOutput(const hal::DigitalOut& output, ActuatorStats& stats) : output(output), stats(stats) {}
+
+void DigitalOutput::set(bool value) {
+	uint32_t now = hal::millis();
+	if (valid && value == lastValue && now - sentMs < KEEP_ALIVE_MS) {
+		stats.saved++;
+		return;
+	}
+	output.set(value);
+	valid = true;
+	lastValue = value;
+	sentMs = now;
+	stats.sent++;
+}
+
+void DigitalOutput::invalidate() {
+	valid = false;
+}
@@ -0,0 +1,87 @@
+#include "main.h"
+#include "controller_output.hpp"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+ControllerOutput controllerOutput;
+
+void ControllerOutput::start(pros::controller_id_e_t controller) {
+	if (mutex != nullptr) {
+		return;
+	}
+	this->controller = controller;
+	mutex = pros::c::mutex_create();
+	pros::c::task_create(outputTask, this, TASK_PRIORITY_MIN + 1, TASK_STACK_DEPTH_DEFAULT, "Controller output");
+}
+
+void ControllerOutput::print(int line, const char* format, ...) {
+	if (mutex == nullptr || line < 0 || line >= LINE_COUNT) {
+		return;
+	}
+	// Padded with spaces so the new text covers whatever was there before
+	char text[LINE_WIDTH + 1];
+	va_list args;
+	va_start(args, format);
+	int length = std::vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	for (int i = length < 0 ? 0 : length; i < LINE_WIDTH; i++) {
+		text[i] = ' ';
+	}
+	text[LINE_WIDTH] = '\0';
+
+	pros::c::mutex_take(mutex, TIMEOUT_MAX);
+	if (std::strcmp(lines[line].text, text) != 0) {
+		std::strcpy(lines[line].text, text);
+		lines[line].dirty = true;
+	}
+	pros::c::mutex_give(mutex);
+}
+
+void ControllerOutput::rumble(const char* pattern) {
+	if (mutex == nullptr) {
+		return;
+	}
+	pros::c::mutex_take(mutex, TIMEOUT_MAX);
+	std::strncpy(rumblePattern, pattern, RUMBLE_SIZE);
+	rumblePattern[RUMBLE_SIZE] = '\0';
+	rumblePending = true;
+	pros::c::mutex_give(mutex);
+}
+
+void ControllerOutput::outputTask(void* param) {
+	ControllerOutput* output = static_cast<ControllerOutput*>(param);
+	uint32_t wakeTime = pros::millis();
+	char text[LINE_WIDTH + 1];
+
+	while (true) {
+		// Picks one update per interval, rumbles first since they are time sensitive
+		int line = -1;
+		bool rumble = false;
+		pros::c::mutex_take(output->mutex, TIMEOUT_MAX);
+		if (output->rumblePending) {
+			rumble = true;
+			std::strcpy(text, output->rumblePattern);
+			output->rumblePending = false;
+		} else {
+			for (int i = 0; i < LINE_COUNT && line < 0; i++) {
+				int candidate = (output->nextLine + i) % LINE_COUNT;
+				if (output->lines[candidate].dirty) {
+					line = candidate;
+					std::strcpy(text, output->lines[line].text);
+					output->lines[line].dirty = false;
+					output->nextLine = (line + 1) % LINE_COUNT;
+				}
+			}
+		}
+		pros::c::mutex_give(output->mutex);
+
+		if (rumble) {
+			pros::c::controller_rumble(output->controller, text);
+		} else if (line >= 0) {
+			pros::c::controller_set_text(output->controller, line, 0, text);
+		}
+		pros::c::task_delay_until(&wakeTime, MIN_INTERVAL_MS);
+	}
+}
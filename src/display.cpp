@@ -0,0 +1,70 @@
+#include "main.h"
+#include "display.hpp"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+Display display;
+
+void Display::start(uint32_t periodMs) {
+	if (mutex != nullptr) {
+		return;
+	}
+	this->periodMs = periodMs;
+	mutex = pros::c::mutex_create();
+	pros::c::task_create(drawTask, this, TASK_PRIORITY_MIN + 1, TASK_STACK_DEPTH_DEFAULT, "Display");
+}
+
+void Display::print(int line, const char* format, ...) {
+	char text[LINE_SIZE];
+	va_list args;
+	va_start(args, format);
+	std::vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	store(line, text);
+}
+
+void Display::set(int line, const char* text) {
+	print(line, "%s", text);
+}
+
+void Display::store(int line, const char* text) {
+	if (line < 0 || line >= LINE_COUNT) {
+		return;
+	}
+	// Lines set before start() are drawn once the task is running
+	if (mutex != nullptr) {
+		pros::c::mutex_take(mutex, TIMEOUT_MAX);
+	}
+	if (std::strcmp(lines[line].text, text) != 0) {
+		std::strcpy(lines[line].text, text);
+		lines[line].dirty = true;
+	}
+	if (mutex != nullptr) {
+		pros::c::mutex_give(mutex);
+	}
+}
+
+void Display::drawTask(void* param) {
+	Display* display = static_cast<Display*>(param);
+	uint32_t wakeTime = pros::millis();
+	char text[LINE_SIZE];
+
+	while (true) {
+		for (int line = 0; line < LINE_COUNT; line++) {
+			// Copied out so set_text runs without holding up print()
+			pros::c::mutex_take(display->mutex, TIMEOUT_MAX);
+			bool dirty = display->lines[line].dirty;
+			if (dirty) {
+				std::strcpy(text, display->lines[line].text);
+				display->lines[line].dirty = false;
+			}
+			pros::c::mutex_give(display->mutex);
+			if (dirty) {
+				pros::lcd::set_text(line, text);
+			}
+		}
+		pros::c::task_delay_until(&wakeTime, display->periodMs);
+	}
+}
@@ -0,0 +1,49 @@
+#include "drive_control.hpp"
+
+#include <algorithm>
+
+#include "bindings.hpp"
+
+DriveControl::DriveControl(const DriverProfile& profile, DriveMode mode) : profile(profile), driveMode(mode) {}
+
+DriveCommand DriveControl::update(const InputLayer& input, uint32_t actions) {
+	if (actions & actionBit(ACTION_TOGGLE_DRIVE_MODE)) {
+		if (driveMode == DRIVE_MODE_ARCADE) {	// Switches drive mode
+			driveMode = DRIVE_MODE_TANK;
+		} else if (driveMode == DRIVE_MODE_TANK) {
+			driveMode = DRIVE_MODE_ARCADE;
+		}
+		// The other mode's filters stopped where they were, so every channel starts from rest
+		leftFilter.reset();
+		rightFilter.reset();
+		forwardFilter.reset();
+		turnFilter.reset();
+	}
+
+	DriveCommand command = {0, 0, 0, false};
+	if (actions & actionBit(ACTION_GOAL_CLAMP)) {
+		command.goalClamp = true;
+	}
+	if (actions & actionBit(ACTION_INTAKE_IN)) {
+		command.intake = 1;
+	} else if (actions & actionBit(ACTION_INTAKE_OUT)) {
+		command.intake = -1;
+	}
+	switch (driveMode) {		// Sets the left and right motor values based on the drive mode
+		case DRIVE_MODE_TANK:
+			command.left = leftFilter.apply(applyCurve(profile.curves[AXIS_LEFT_Y], input.axis(AXIS_LEFT_Y)));
+			command.right = rightFilter.apply(applyCurve(profile.curves[AXIS_RIGHT_Y], input.axis(AXIS_RIGHT_Y)));
+			break;
+		case DRIVE_MODE_ARCADE:
+			int direction = forwardFilter.apply(applyCurve(profile.curves[AXIS_LEFT_Y], input.axis(AXIS_LEFT_Y)));
+			int turn = turnFilter.apply(applyCurve(profile.curves[AXIS_RIGHT_X], input.axis(AXIS_RIGHT_X)) * -2);
+			command.left = std::clamp(direction + turn, -127, 127);
+			command.right = std::clamp(direction - turn, -127, 127);
+			break;
+	}
+	return command;
+}
+
+DriveMode DriveControl::mode() const {
+	return driveMode;
+}
@@ -0,0 +1,158 @@
+#include "input.hpp"
+
+InputLayer::InputLayer(hal::Controller controller, InputTiming timing) : controller(controller), timing(timing) {}
+
+int InputLayer::addChord(uint16_t buttons) {
+	if (chordCount >= MAX_CHORDS) {
+		return -1;
+	}
+	chords[chordCount] = buttons;
+	chordsArmed |= 1 << chordCount;
+	return chordCount++;
+}
+
+void InputLayer::readOnly(uint16_t buttons, uint8_t axes) {
+	readButtons = buttons;
+	readAxes = axes;
+}
+
+void InputLayer::update() {
+	// PROS has no call that returns the whole controller, so every button and
+	// stick in use is read here exactly once and nothing else touches the controller
+	InputFrame frame;
+	frame.timeMs = hal::millis();
+	frame.buttons = 0;
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		if ((readButtons & buttonMask(Button(i))) && controller.digital(i)) {
+			frame.buttons |= buttonMask(Button(i));
+		}
+	}
+	for (int i = 0; i < AXIS_COUNT; i++) {
+		frame.axes[i] = (readAxes & axisMask(Axis(i))) ? int8_t(controller.analog(i)) : 0;
+	}
+	update(frame);
+}
+
+void InputLayer::update(const InputFrame& frame) {
+	uint16_t previous = current.buttons;
+	current = frame;
+	pressedMask = frame.buttons & ~previous;
+	releasedMask = previous & ~frame.buttons;
+	heldMask = 0;
+	doubleTapMask = 0;
+	chordsFired = 0;
+	bufferedEvents = 0;
+	holdDone &= frame.buttons;
+
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		uint16_t mask = buttonMask(Button(i));
+		if (pressedMask & mask) {
+			pressTime[i] = frame.timeMs;
+			addEvent(INPUT_PRESS, mask);
+			if ((tapArmed & mask) && frame.timeMs - lastTapTime[i] <= timing.doubleTapMs) {
+				doubleTapMask |= mask;
+				tapArmed &= ~mask;		// A third tap starts a new pair rather than firing again
+			} else {
+				tapArmed |= mask;
+				lastTapTime[i] = frame.timeMs;
+			}
+		}
+		if (releasedMask & mask) {
+			addEvent(INPUT_RELEASE, mask);
+		}
+	}
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		uint16_t mask = buttonMask(Button(i));
+		if ((frame.buttons & mask) && !(holdDone & mask) && frame.timeMs - pressTime[i] >= timing.holdMs) {
+			heldMask |= mask;
+			holdDone |= mask;
+			addEvent(INPUT_HOLD, mask);
+		}
+		if (doubleTapMask & mask) {
+			addEvent(INPUT_DOUBLE_TAP, mask);
+		}
+	}
+
+	for (int c = 0; c < chordCount; c++) {
+		uint16_t buttons = chords[c];
+		uint8_t bit = 1 << c;
+		if ((frame.buttons & buttons) == 0) {
+			chordsArmed |= bit;		// Re-armed once every button is up
+		} else if ((chordsArmed & bit) && (frame.buttons & buttons) == buttons) {
+			// Only fires if the buttons went down close enough together
+			uint32_t first = frame.timeMs;
+			for (int i = 0; i < BUTTON_COUNT; i++) {
+				if ((buttons & buttonMask(Button(i))) && int32_t(pressTime[i] - first) < 0) {
+					first = pressTime[i];
+				}
+			}
+			chordsArmed &= ~bit;
+			if (timing.chordWindowMs == 0 || frame.timeMs - first <= timing.chordWindowMs) {
+				chordsFired |= bit;
+				addEvent(INPUT_CHORD, buttons);
+			}
+		}
+	}
+}
+
+const InputFrame& InputLayer::frame() const {
+	return current;
+}
+
+bool InputLayer::down(Button button) const {
+	return current.buttons & buttonMask(button);
+}
+
+bool InputLayer::pressed(Button button) const {
+	return pressedMask & buttonMask(button);
+}
+
+bool InputLayer::released(Button button) const {
+	return releasedMask & buttonMask(button);
+}
+
+bool InputLayer::held(Button button) const {
+	return heldMask & buttonMask(button);
+}
+
+bool InputLayer::doubleTapped(Button button) const {
+	return doubleTapMask & buttonMask(button);
+}
+
+uint16_t InputLayer::pressedButtons() const {
+	return pressedMask;
+}
+
+uint16_t InputLayer::releasedButtons() const {
+	return releasedMask;
+}
+
+uint16_t InputLayer::heldButtons() const {
+	return heldMask;
+}
+
+uint16_t InputLayer::doubleTappedButtons() const {
+	return doubleTapMask;
+}
+
+bool InputLayer::chord(int id) const {
+	return id >= 0 && id < chordCount && (chordsFired & (1 << id));
+}
+
+int InputLayer::axis(Axis axis) const {
+	return current.axes[axis];
+}
+
+const InputEvent* InputLayer::events() const {
+	return eventBuffer;
+}
+
+int InputLayer::eventCount() const {
+	return bufferedEvents;
+}
+
+void InputLayer::addEvent(InputEventType type, uint16_t buttons) {
+	if (bufferedEvents < MAX_EVENTS) {
+		eventBuffer[bufferedEvents++] = {type, buttons};
+	}
+}
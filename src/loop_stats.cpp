@@ -0,0 +1,135 @@
+#include "main.h"
+#include "loop_stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+void LatencyHistogram::add(uint32_t us) {
+	buckets[std::min<uint32_t>(us / BUCKET_US, BUCKET_COUNT - 1)]++;
+	total++;
+	largest = std::max(largest, us);
+}
+
+void LatencyHistogram::clear() {
+	std::fill(std::begin(buckets), std::end(buckets), 0);
+	total = 0;
+	largest = 0;
+}
+
+uint32_t LatencyHistogram::count() const {
+	return total;
+}
+
+uint32_t LatencyHistogram::max() const {
+	return largest;
+}
+
+uint32_t LatencyHistogram::percentile(float fraction) const {
+	if (total == 0) {
+		return 0;
+	}
+	uint32_t wanted = std::max<uint32_t>(1, std::ceil(total * fraction));
+	uint32_t seen = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		seen += buckets[i];
+		if (seen >= wanted) {
+			return std::min((i + 1) * BUCKET_US, largest);
+		}
+	}
+	return largest;
+}
+
+LoopStats::LoopStats(const char* name, uint32_t budgetUs) : name(name), budgetUs(budgetUs) {}
+
+void LoopStats::begin() {
+	uint64_t now = pros::micros();
+	if (lastBegin != 0) {
+		period.add(now - lastBegin);
+	}
+	lastBegin = now;
+}
+
+void LoopStats::end() {
+	uint32_t workUs = pros::micros() - lastBegin;
+	work.add(workUs);
+	if (workUs > budgetUs) {
+		overrunCount++;
+	}
+}
+
+LoopReport LoopStats::report(const PeriodicScheduler& scheduler) const {
+	LoopReport report = {};
+	std::strncpy(report.name, name, sizeof(report.name) - 1);
+	report.timeMs = pros::millis();
+	report.count = work.count();
+	report.periodP50 = period.percentile(0.5);
+	report.periodP99 = period.percentile(0.99);
+	report.periodMax = period.max();
+	report.workP50 = work.percentile(0.5);
+	report.workP99 = work.percentile(0.99);
+	report.workMax = work.max();
+	report.overruns = overrunCount;
+	report.late = scheduler.overruns();
+	report.skipped = scheduler.skipped();
+	return report;
+}
+
+void LoopStats::clear() {
+	lastBegin = 0;
+	period.clear();
+	work.clear();
+	overrunCount = 0;
+}
+
+void loopReportText(const LoopReport& report, char* text, size_t size) {
+	std::snprintf(text, size, "%s %.1f/%.1f/%.1fms work %.1f/%.1fms %u over %u late/%u skip", report.name,
+	              report.periodP50 / 1000.0, report.periodP99 / 1000.0, report.periodMax / 1000.0,
+	              report.workP50 / 1000.0, report.workP99 / 1000.0, unsigned(report.overruns),
+	              unsigned(report.late), unsigned(report.skipped));
+}
+
+LoopStatsLog loopStatsLog;
+
+void LoopStatsLog::start() {
+	if (reports != nullptr) {
+		return;
+	}
+	reports = pros::c::queue_create(8, sizeof(LoopReport));
+	pros::c::task_create(logTask, this, TASK_PRIORITY_MIN + 1, TASK_STACK_DEPTH_DEFAULT, "Loop stats log");
+}
+
+void LoopStatsLog::publish(const LoopReport& report) {
+	if (reports != nullptr) {
+		pros::c::queue_append(reports, &report, 0);
+	}
+}
+
+void LoopStatsLog::logTask(void* param) {
+	LoopStatsLog* log = static_cast<LoopStatsLog*>(param);
+	LoopReport report;
+
+	while (true) {
+		if (!pros::c::queue_recv(log->reports, &report, TIMEOUT_MAX)) {
+			continue;
+		}
+		char text[96];
+		loopReportText(report, text, sizeof(text));
+		std::printf("[%u] %s\n", unsigned(report.timeMs), text);
+
+		FILE* file = std::fopen(FILE_PATH, "a");
+		if (file == nullptr) {
+			continue;		// No SD card, serial still gets it
+		}
+		std::fseek(file, 0, SEEK_END);
+		if (std::ftell(file) == 0) {
+			std::fputs("time_ms,loop,count,period_p50_us,period_p99_us,period_max_us,work_p50_us,work_p99_us,work_max_us,overruns,late,skipped\n", file);
+		}
+		std::fprintf(file, "%u,%s,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", unsigned(report.timeMs), report.name, unsigned(report.count),
+		             unsigned(report.periodP50), unsigned(report.periodP99), unsigned(report.periodMax),
+		             unsigned(report.workP50), unsigned(report.workP99), unsigned(report.workMax), unsigned(report.overruns),
+		             unsigned(report.late), unsigned(report.skipped));
+		std::fclose(file);
+	}
+}
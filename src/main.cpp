@@ -1,44 +1,31 @@
 #include "main.h"
-#include <chrono>
-
-struct Iteration {
-	int16_t left;
-	int16_t right;
-	int16_t intake;
-	bool goalClamp;
-};
-
-int interpolate(float last, float current, float strength) {
-	return last + (current - last) * strength;
-}
-
-enum DriveMode {
-	DRIVE_MODE_TANK,
-	DRIVE_MODE_ARCADE
-};
-enum Status {
-	STATUS_RECORDING,
-	STATUS_RECORD_COUNTDOWN,
-	STATUS_REPLAYING,
-	STATUS_DRIVING,
-	STATUS_REPLAY_COUTNDOWN
-};
-int replaySaveSlot = 0;
+#include "actuators.hpp"
+#include "controller_output.hpp"
+#include "bindings.hpp"
+#include "display.hpp"
+#include "drive_control.hpp"
+#include "filters.hpp"
+#include "hal.hpp"
+#include "input.hpp"
+#include "loop_stats.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
+#include "robot_tasks.hpp"
+#include "scheduler.hpp"
+#include "telemetry.hpp"
+#include "trajectory.hpp"
 
 /**
  * A callback function for LLEMU's center button.
  */
 void on_center_button() {
-	replaySaveSlot = std::clamp(replaySaveSlot - 1, 0, 9);
-	pros::lcd::set_text(3, "Replay slot: " + std::to_string(replaySaveSlot));
+	channels.send(EVENT_SLOT_PREVIOUS);		// The replay task owns the slot, the UI task shows it
 }
 void on_left_button() {
-	replaySaveSlot = 0;
-	pros::lcd::set_text(3, "Replay slot: " + std::to_string(replaySaveSlot));
+	channels.send(EVENT_SLOT_FIRST);
 }
 void on_right_button() {
-	replaySaveSlot = std::clamp(replaySaveSlot + 1, 0, 9);
-	pros::lcd::set_text(3, "Replay slot: " + std::to_string(replaySaveSlot));
+	channels.send(EVENT_SLOT_NEXT);
 }
 
 /**
@@ -49,11 +36,30 @@ void on_right_button() {
  */
 void initialize() {
 	pros::lcd::initialize();
+	display.start();
+	controllerOutput.start();
 	
 	pros::lcd::register_btn1_cb(on_center_button);
 	pros::lcd::register_btn0_cb(on_left_button);
 	pros::lcd::register_btn2_cb(on_right_button);
 
+	replayRecorder.start();
+	replayCache.start();	// Loads every replay slot in the background
+
+	// Everything recorded alongside a replay, ports match the ones used below
+	telemetryRecorder.addMotors("left", {-20, -1});
+	telemetryRecorder.addMotors("right", {19, 2});
+	telemetryRecorder.addMotors("intake", {-18});
+	telemetryRecorder.addMotors("ramp", {-17});
+	telemetryRecorder.addAdiPort("clamp", 'A');
+	telemetryRecorder.start();
+	loopStatsLog.start();
+
+	// Operator control's replay and UI tasks, see robot_tasks.hpp
+	channels.start();
+	replayTask.start(CONTROL_TICK_MS);
+	uiTask.start();
+
 	pros::ADIDigitalOut goalClamp('A');
 	pros::Controller master(pros::E_CONTROLLER_MASTER);
 
@@ -66,7 +72,7 @@ void initialize() {
  * the robot is enabled, this task will exit.
  */
 void disabled() {
-	pros::lcd::set_text(0, "Disabled");
+	display.set(0, "Disabled");
 }
 
 /**
@@ -80,7 +86,9 @@ void disabled() {
  */
 void competition_initialize() {
 	pros::Controller master(pros::E_CONTROLLER_MASTER);	
-	pros::lcd::set_text(0, "Comp init");
+	display.set(0, "Comp init");
+	replayCache.start();
+	display.set(5, replayCache.validSlotsText().c_str());
 	return;
 }
 
@@ -96,55 +104,94 @@ void competition_initialize() {
  * from where it left off.
  */
 void autonomous() {
-	pros::lcd::set_text(0, "Autonomous with replay slot " + std::to_string(replaySaveSlot));
+	int slot = channels.replayState.read().slot;
+	display.print(0, "Autonomous with replay slot %d", slot);
 	
-	pros::MotorGroup left_mg({-20, -1});
-	pros::MotorGroup right_mg({19, 2});
-	pros::Motor intake(-18);
-	pros::Motor ramp(-17);
-	pros::adi::DigitalOut goalClamp('A');
+	hal::MotorGroup left_mg({-20, -1});
+	hal::MotorGroup right_mg({19, 2});
+	hal::MotorGroup intake({-18});
+	hal::MotorGroup ramp({-17});
+	hal::DigitalOut goalClamp('A');
 	pros::ADILED leds('B', 56);
 
+	// Every write goes through these, so unchanged commands stay off the bus
+	ActuatorStats actuatorStats = {};
+	MotorOutput leftOutput(left_mg, actuatorStats);
+	MotorOutput rightOutput(right_mg, actuatorStats);
+	MotorOutput intakeOutput(intake, actuatorStats);
+	MotorOutput rampOutput(ramp, actuatorStats);
+	DigitalOutput goalClampOutput(goalClamp, actuatorStats);
+
 	int driveDeadzone = 10;
-	Iteration iterations[750];
-
-	std::string filePath = "/usd/replay" + std::to_string(replaySaveSlot) + ".bin";
-	const char * fileName = filePath.c_str();
-	FILE* usd_file_read = fopen(fileName, "r");
-	//FILE* usd_file_read = fopen("/usd/replay.bin", "r");
-	if (usd_file_read == nullptr) {
-		pros::lcd::set_text(2, "Failed to open read file");
-		return;
-	}
-	size_t elementsRead = std::fread(iterations, sizeof(Iteration), 750, usd_file_read); 
-	if (elementsRead != 750) {
-		pros::lcd::set_text(2, "Error reading data from file!");
+	IntakeFilter intakeFilter;		// Ramps the intake the same way opcontrol() did while recording
+	static ReplayReader reader;		// Static so the chunk buffers stay off the task stack
+
+	if (!reader.open(slot)) {
+		display.set(2, "Failed to open read file");
 		return;
 	}
-	std::fclose(usd_file_read); 
 
-	for (int i = 0; i < 750; i++) {
-		if (iterations[i].left < -driveDeadzone || iterations[i].left > driveDeadzone) {		// Moves the motor groups, brake if inside deadzone
-			left_mg.move(iterations[i].left);	
+	// Replays that recorded the drive's trajectory are followed closed loop
+	bool closedLoop = reader.hasTrajectory();
+	TrajectoryFollower leftFollower;
+	TrajectoryFollower rightFollower;
+	leftFollower.reset(left_mg.position());
+	rightFollower.reset(right_mg.position());
+
+	// Plays at the rate it was recorded, on a fixed grid so slow ticks don't stretch the period
+	PeriodicScheduler scheduler(reader.tickMs());
+
+	// Looks commands up by time since the start, so a late loop never shifts the rest of the replay
+	LoopStats loopStats("autonomous", scheduler.period() * 1000);
+	scheduler.start();
+	uint64_t startTime = hal::micros();
+	uint64_t elapsed = 0;
+	uint64_t lastElapsed = 0;
+	Iteration iteration;
+	while (reader.at(elapsed, iteration)) {
+		loopStats.begin();
+		int left = iteration.left;
+		int right = iteration.right;
+		if (closedLoop) {
+			float dt = (elapsed - lastElapsed) / 1e6f;
+			left = leftFollower.update(iteration.left, iteration.leftPosition, iteration.leftVelocity, left_mg.position(), left_mg.velocity(), dt);
+			right = rightFollower.update(iteration.right, iteration.rightPosition, iteration.rightVelocity, right_mg.position(), right_mg.velocity(), dt);
+		}
+		if (left < -driveDeadzone || left > driveDeadzone) {		// Moves the motor groups, brake if inside deadzone
+			leftOutput.move(left);
 		} else {
-			left_mg.brake();
+			leftOutput.brake();
 		}
-		if (iterations[i].right < -driveDeadzone || iterations[i].right > driveDeadzone) {
-			right_mg.move(iterations[i].right);
+		if (right < -driveDeadzone || right > driveDeadzone) {
+			rightOutput.move(right);
 		} else {
-			right_mg.brake();
+			rightOutput.brake();
 		}
-		intake.move(iterations[i].intake * 127);
-		ramp.move(iterations[i].intake * 127);
-		goalClamp.set_value(iterations[i].goalClamp);
-		pros::lcd::set_text(1, "Time " + std::to_string(i));
-		pros::delay(20);
+		int intakePower = intakeFilter.apply(iteration.intake * 127);
+		intakeOutput.move(intakePower);
+		rampOutput.move(intakePower);
+		goalClampOutput.set(iteration.goalClamp);
+		display.print(1, "Time %ums", unsigned(elapsed / 1000));
+		loopStats.end();
+		scheduler.wait();
+		lastElapsed = elapsed;
+		elapsed = hal::micros() - startTime;
 	}
-	left_mg.move(0);
-	right_mg.move(0);
-	intake.move(0);
-	ramp.move(0);
-	goalClamp.set_value(false);
+	if (reader.failed()) {
+		display.set(2, "Error reading data from file!");
+	} else if (closedLoop) {
+		showTrackingError(leftFollower, rightFollower);
+	}
+	LoopReport report = loopStats.report(scheduler);
+	showLoopReport(report);
+	loopStatsLog.publish(report);
+	showActuatorStats(actuatorStats);
+	reader.close();
+	leftOutput.move(0);
+	rightOutput.move(0);
+	intakeOutput.move(0);
+	rampOutput.move(0);
+	goalClampOutput.set(false);
 }
 
 /**
@@ -162,212 +209,131 @@ void autonomous() {
  */
 
 void opcontrol() {
-	pros::lcd::set_text(0, "Operator control");
-
-	pros::Controller master(pros::E_CONTROLLER_MASTER);
-	pros::MotorGroup left_mg({-20, -1});
-	pros::MotorGroup right_mg({19, 2});
-	pros::Motor intake(-18);
-	pros::Motor ramp(-17);
-	pros::adi::DigitalOut goalClamp('A');
+	// This task is the control task, nothing else may hold up the motors
+	pros::c::task_set_priority(CURRENT_TASK, CONTROL_TASK_PRIORITY);
+
+	InputLayer input;		// The master controller
+	Bindings<DRIVER_BINDINGS> bindings(input);		// The button layout is in bindings.hpp
+	DriveControl drive;		// Stick curves are in drive_curves.hpp, filters in filters.hpp
+	input.readOnly(bindings.BUTTONS, drive.AXES);		// Nothing else on the controller is read
+	hal::MotorGroup left_mg({-20, -1});
+	hal::MotorGroup right_mg({19, 2});
+	hal::MotorGroup intake({-18});
+	hal::MotorGroup ramp({-17});
+	hal::DigitalOut goalClamp('A');
 	pros::ADILED leds('B', 56);
 
-	int driveDeadzone = 10;
-	DriveMode driveMode = DRIVE_MODE_ARCADE;
-	float interpolateStrength = 0.2;
-	int lastTurn = 0;
-	bool lastGoalClamp = false;
-	bool switchButtonStatus = 0;	// 0 -> not pressed, 1 -> held, 2 -> just pressed
+	// Every write goes through these, so unchanged commands stay off the bus
+	ActuatorStats actuatorStats = {};
+	MotorOutput leftOutput(left_mg, actuatorStats);
+	MotorOutput rightOutput(right_mg, actuatorStats);
+	MotorOutput intakeOutput(intake, actuatorStats);
+	MotorOutput rampOutput(ramp, actuatorStats);
+	DigitalOutput goalClampOutput(goalClamp, actuatorStats);
 
-	Status runStatus = STATUS_DRIVING;
-	Iteration iterations[750];
+	int driveDeadzone = 10;
+	IntakeFilter intakeFilter;
+	int i = 0;	// Ticks since the last loop timing report
 
-	int time = 0;
-	int i = 0;	// Used for timing the loop
+	leds.set_all(0x808080);
 
-	replaySaveSlot = 0;
+	// Anything left running from before opcontrol() was restarted is dropped, and the slot goes back to 0
+	channels.send(EVENT_RESET);
 
-	leds.set_all(0x808080);
+	// Last copies from the replay task, kept if a read lands in the middle of its write
+	ReplayState replay = {STATUS_DRIVING, 0, 0, 0};
+	ReplayOutput output = {};
 
+	PeriodicScheduler scheduler(CONTROL_TICK_MS);	// A true CONTROL_TICK_MS period, however long the loop body takes
+	LoopStats loopStats("opcontrol", CONTROL_TICK_MS * 1000);
+	scheduler.start();
 	while (true) {
-		std::chrono::_V2::system_clock::time_point begin = std::chrono::high_resolution_clock::now();
+		loopStats.begin();
+		PROFILE_LAP(STAGE_CONTROLLER_READ);
+		input.update();		// The only controller read of the tick
+		uint32_t actions = bindings.evaluate(input);
+		channels.replayState.tryRead(replay);
 		
-		if (runStatus == STATUS_DRIVING) {			// Switches load slot
-			if (master.get_digital_new_press(DIGITAL_UP)) {
-				replaySaveSlot = std::clamp(replaySaveSlot + 1, 0, 9);
-				pros::lcd::set_text(3, "Replay slot: " + std::to_string(replaySaveSlot));
-				std::string text = "Replay slot: " + std::to_string(replaySaveSlot);
-				master.print(0, 0, text.c_str());
-			} else if (master.get_digital_new_press(DIGITAL_DOWN)) {
-				replaySaveSlot = std::clamp(replaySaveSlot - 1, 0, 9);
-				pros::lcd::set_text(3, "Replay slot: " + std::to_string(replaySaveSlot));
-				std::string text = "Replay slot: " + std::to_string(replaySaveSlot);
-				master.print(0, 0, text.c_str());
-			}
-		}
-		if (master.get_digital(DIGITAL_Y) && master.get_digital(DIGITAL_B)  && switchButtonStatus == 0) {
-			switchButtonStatus = 2;
-			if (driveMode == DRIVE_MODE_ARCADE) {	// Switches drive mode
-				driveMode = DRIVE_MODE_TANK;
-				master.print(0, 0, "Tank drive           ");
-			} else if (driveMode == DRIVE_MODE_TANK) {
-				driveMode = DRIVE_MODE_ARCADE;
-				master.print(0, 0, "Arcade drive             ");
+		if (replay.status == STATUS_DRIVING) {			// Switches load slot
+			if (actions & actionBit(ACTION_SLOT_NEXT)) {
+				channels.send(EVENT_SLOT_NEXT);
+			} else if (actions & actionBit(ACTION_SLOT_PREVIOUS)) {
+				channels.send(EVENT_SLOT_PREVIOUS);
 			}
-		} else if (master.get_digital(DIGITAL_Y) && master.get_digital(DIGITAL_B) && switchButtonStatus == 2) {
-			switchButtonStatus = 1;
-		} else if (!master.get_digital(DIGITAL_Y) && !master.get_digital(DIGITAL_B) && switchButtonStatus == 1) {
-			switchButtonStatus = 0;
-		}
-		int left = 0;
-		int right = 0;
-		int intakeDirection = 0;
-		bool goalClampControl = false;
-		if (master.get_digital(DIGITAL_R1)) {
-			goalClampControl = true;
 		}
-		if (master.get_digital(DIGITAL_L1)) {
-			intakeDirection = 1;
-		} else if (master.get_digital(DIGITAL_L2)) {
-			intakeDirection = -1;
+		PROFILE_LAP(STAGE_DRIVE_MATH);
+		DriveCommand command = drive.update(input, actions);
+		int left = command.left;
+		int right = command.right;
+		int intakeDirection = command.intake;
+		bool goalClampControl = command.goalClamp;
+
+		// Hands this tick to the replay task, which records it or works out the replay output
+		PROFILE_LAP(STAGE_RECORD_REPLAY);
+		if (actions & actionBit(ACTION_RECORD)) {
+			channels.send(EVENT_RECORD);
 		}
-		switch (driveMode) {		// Sets the left and right motor values based on the drive mode
-			case DRIVE_MODE_TANK:
-				left = master.get_analog(ANALOG_LEFT_Y);
-				right = master.get_analog(ANALOG_RIGHT_Y);
-				break;
-			case DRIVE_MODE_ARCADE:
-				int direction = master.get_analog(ANALOG_LEFT_Y);
-				int turn = interpolate(lastTurn, master.get_analog(ANALOG_RIGHT_X) * -2, interpolateStrength);
-				lastTurn = turn;
-				left = std::clamp(direction + turn, -127, 127);
-				right = std::clamp(direction - turn, -127, 127);
-				break;
+		if (actions & actionBit(ACTION_REPLAY)) {
+			channels.send(EVENT_REPLAY);
 		}
-
-		// Change recording / replay / driving mode
-		if (master.get_digital(DIGITAL_X) && runStatus == STATUS_DRIVING) {
-			// Start countdown
-			runStatus = STATUS_RECORD_COUNTDOWN;
-			time = 0;
-		} else if (runStatus == STATUS_RECORD_COUNTDOWN && time < 150) {
-			time += 1;
-			pros::lcd::set_text(0, "Recording in " + std::to_string(3.0 - float(time * 20) / 1000.0) + " seconds");
-		} else if (runStatus == STATUS_RECORD_COUNTDOWN && time >= 150) {
-			// Start recording
-			pros::lcd::set_text(0, "Recording");
-			runStatus = STATUS_RECORDING;
-			time = 0;
-		} else if (runStatus == STATUS_RECORDING && time < 750) {
-			// Recording ------------
-			iterations[time].left = left;
-			iterations[time].right = right;
-			iterations[time].intake = intakeDirection;
-			iterations[time].goalClamp = goalClampControl;
-
-			time++;
-		} else if (runStatus == STATUS_RECORDING && time >= 750) {
-			// End recording
-			runStatus = STATUS_DRIVING;
-			pros::lcd::set_text(0, "Driving");
-			// Saves the file to disk
-			std::string filePath = "/usd/replay" + std::to_string(replaySaveSlot) + ".bin";
-			const char * fileName = filePath.c_str();
-			FILE* usd_file_write = fopen(fileName, "wb");
-			//FILE* usd_file_write = fopen("/usd/replay.bin", "wb");
-			if (usd_file_write == nullptr) {
-				pros::lcd::set_text(0, "Failed to open file");
-				return;
-			}
-			
-			size_t elementsWritten = std::fwrite(iterations, sizeof(Iteration), 750, usd_file_write);
-			if (elementsWritten != 750) {
-				pros::lcd::set_text(2, "Error writing data to file!");
-				return;
-			} else {
-				pros::lcd::set_text(2, "Array written to file successfully!");
-			}
-			std::fclose(usd_file_write);
+		DriverSample sample = {hal::micros(), {int16_t(left), int16_t(right), int16_t(intakeDirection), goalClampControl, 0, 0, 0, 0}, false};
+		if (replay.status != STATUS_DRIVING) {
+			// Only read when something needs them, around recording and replaying
+			sample.iteration.leftPosition = int32_t(std::lround(left_mg.position() * 10));
+			sample.iteration.rightPosition = int32_t(std::lround(right_mg.position() * 10));
+			sample.iteration.leftVelocity = int16_t(std::lround(left_mg.velocity()));
+			sample.iteration.rightVelocity = int16_t(std::lround(right_mg.velocity()));
+			sample.haveDrive = true;
 		}
-
-		if (master.get_digital(DIGITAL_A) && runStatus == STATUS_DRIVING) {
-			// Start replay
-			runStatus = STATUS_REPLAY_COUTNDOWN;
-			time = 0;
-		} else if (runStatus == STATUS_REPLAY_COUTNDOWN && time < 150) {
-			// Replay countdown
-			time++;
-			pros::lcd::set_text(0, "Replaying in " + std::to_string(3.0 - float(time * 20) / 1000.0) + " seconds");
-		} else if (runStatus == STATUS_REPLAY_COUTNDOWN && time >= 150) {
-			// Starts replay
-			time = 0;
-			runStatus = STATUS_REPLAYING;
-			pros::lcd::set_text(0, "Replaying");
-			// Loads file from disk
-			std::string filePath = "/usd/replay" + std::to_string(replaySaveSlot) + ".bin";
-			const char * fileName = filePath.c_str();
-			FILE* usd_file_read = fopen(fileName, "r");
-			//FILE* usd_file_read = fopen("/usd/replay.bin", "r");
-			if (usd_file_read == nullptr) {
-				pros::lcd::set_text(2, "Failed to open read file");
-				return;
-			}
-			size_t elementsRead = std::fread(iterations, sizeof(Iteration), 750, usd_file_read); 
-			if (elementsRead != 750) {
-				pros::lcd::set_text(2, "Error reading data from file!");
-				return;
-			}
-			std::fclose(usd_file_read); 
-
-		} else if (runStatus == STATUS_REPLAYING && time < 750) {
-			// Replaying ------------
-			left = iterations[time].left;
-			right = iterations[time].right;
-			intakeDirection = iterations[time].intake;
-			goalClampControl = iterations[time].goalClamp;
-			time++;
-		} else if (runStatus == STATUS_REPLAYING && time >= 750) {
-			// End replay
-			runStatus = STATUS_DRIVING;
-			pros::lcd::set_text(0, "Driving");
+		channels.sendSample(sample);	// Never waits, a sample is dropped if the replay task is stuck
+
+		channels.replayOutput.tryRead(output);
+		if (output.active) {
+			left = output.left;
+			right = output.right;
+			intakeDirection = output.intake;
+			goalClampControl = output.goalClamp;
 		}
 
 		// This is when the robot is not countdowning (don't know if thats even a word)
-		if (runStatus != STATUS_RECORD_COUNTDOWN && runStatus != STATUS_REPLAY_COUTNDOWN) {
+		PROFILE_LAP(STAGE_MOTORS);
+		if (replay.status != STATUS_RECORD_COUNTDOWN && replay.status != STATUS_REPLAY_COUTNDOWN) {
 			if (left < -driveDeadzone || left > driveDeadzone) {		// Moves the motor groups, brake if inside deadzone
-				left_mg.move(left);	
+				leftOutput.move(left);
 			} else {
-				left_mg.brake();
+				leftOutput.brake();
 				left = 0;
 			}
 			if (right < -driveDeadzone || right > driveDeadzone) {
-				right_mg.move(right);
+				rightOutput.move(right);
 			} else {
-				right_mg.brake();
+				rightOutput.brake();
 				right = 0;
 			}
-			intake.move(intakeDirection * 127);		// Moves the intake and roller
-			ramp.move(intakeDirection * 127);
-			goalClamp.set_value(goalClampControl);	// Moves the goal clamp
+			int intakePower = intakeFilter.apply(intakeDirection * 127);	// Replays go through it too
+			intakeOutput.move(intakePower);		// Moves the intake and roller
+			rampOutput.move(intakePower);
+			goalClampOutput.set(goalClampControl);	// Moves the goal clamp
 		}
 
-		pros::lcd::set_text(1, "Time " + std::to_string(time));
-		lastGoalClamp = goalClampControl;
-
-		std::chrono::_V2::system_clock::time_point end = std::chrono::high_resolution_clock::now();
-		std::chrono::duration<double> elapsed = end - begin;
-
+		// The UI task draws all of this at its own pace
+		PROFILE_LAP(STAGE_LCD);
+		channels.robotState.write({hal::millis(), drive.mode(), replay.status, replay.slot, replay.time, replay.countdownEnd,
+		                           left, right, intakeDirection, goalClampControl});
 		if (i >= 50) {
 			i = 0;
-			pros::lcd::set_text(4, "Time taken: " + std::to_string(elapsed.count()));
+			channels.loopReport.write(loopStats.report(scheduler));
+			channels.actuatorStats.write(actuatorStats);
 		}
 
 		i++;
-		pros::delay(20);
+		PROFILE_TICK();
+		PROFILE_REPORT_EVERY(250);
+		loopStats.end();
+		scheduler.wait();
 	}
 }
 
-
 // void opcontrol() {
 // 	return;
 // 	pros::Controller master(pros::E_CONTROLLER_MASTER);
@@ -0,0 +1,64 @@
+#include "profiler.hpp"
+
+#ifdef PROFILE_STAGES
+
+#include <cstdio>
+
+#include "pros/rtos.h"
+
+StageProfiler stageProfiler;
+
+namespace {
+const char* const STAGE_NAMES[STAGE_COUNT] = {
+	"controller read",
+	"drive math",
+	"record/replay",
+	"motors",
+	"lcd"
+};
+}  // namespace
+
+void StageProfiler::lap(ProfileStage stage) {
+	uint64_t now = pros::c::micros();
+	if (lapping) {
+		tickUs[lapStage] += uint32_t(now - lapStart);
+	}
+	lapping = true;
+	lapStage = stage;
+	lapStart = now;
+}
+
+void StageProfiler::tick() {
+	if (lapping) {
+		lap(lapStage);
+		lapping = false;
+	}
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		totalUs[stage] += tickUs[stage];
+		if (tickUs[stage] > maxUs[stage]) {
+			maxUs[stage] = tickUs[stage];
+		}
+		tickUs[stage] = 0;
+	}
+	ticks++;
+}
+
+void StageProfiler::report() {
+	if (ticks == 0) {
+		return;
+	}
+	uint64_t allUs = 0;
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		allUs += totalUs[stage];
+	}
+	std::printf("Stage times over %u ticks, avg/max us per tick:\n", unsigned(ticks));
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		std::printf("  %-17s %7.1f %7u %5.1f%%\n", STAGE_NAMES[stage], double(totalUs[stage]) / ticks, unsigned(maxUs[stage]),
+		            allUs > 0 ? 100.0 * totalUs[stage] / allUs : 0.0);
+		totalUs[stage] = 0;
+		maxUs[stage] = 0;
+	}
+	ticks = 0;
+}
+
+#endif  // PROFILE_STAGES
@@ -0,0 +1,566 @@
+#include "main.h"
+#include "replay.hpp"
+#include "display.hpp"
+#include "hal.hpp"
+#include <algorithm>
+#include <cstring>
+
+std::string replayFilePath(int slot, const char* extension) {
+	return hal::storagePath("replay" + std::to_string(slot) + "." + extension);
+}
+
+std::string replayCopyPath(int slot, int copy) {
+	return copy == 0 ? replayFilePath(slot) : hal::storagePath("replay" + std::to_string(slot) + "b.bin");
+}
+
+int replayNewestCopy(int slot, uint32_t& generation) {
+	int newest = -1;
+	generation = 0;
+	for (int copy = 0; copy < 2; copy++) {
+		FILE* file = std::fopen(replayCopyPath(slot, copy).c_str(), "rb");
+		if (file == nullptr) {
+			continue;
+		}
+		uint8_t head[sizeof(ReplayHeader)];
+		uint8_t tail[REPLAY_END_SIZE];
+		size_t headSize = std::fread(head, 1, sizeof(head), file);
+		std::fseek(file, 0, SEEK_END);
+		long fileSize = std::ftell(file);
+		size_t tailSize = 0;
+		if (fileSize > 0) {
+			tailSize = std::min<size_t>(fileSize, sizeof(tail));
+			std::fseek(file, fileSize - tailSize, SEEK_SET);
+			tailSize = std::fread(tail, 1, tailSize, file);
+		}
+		std::fclose(file);
+		uint32_t copyGeneration;
+		if (replayFileGeneration(head, headSize, tail, tailSize, copyGeneration) && (newest < 0 || copyGeneration > generation)) {
+			newest = copy;
+			generation = copyGeneration;
+		}
+	}
+	return newest;
+}
+
+std::shared_ptr<CachedReplay> replayLoadFile(const std::string& filePath) {
+	FILE* file = std::fopen(filePath.c_str(), "rb");
+	if (file == nullptr) {
+		return nullptr;
+	}
+	std::vector<uint8_t> data;
+	std::fseek(file, 0, SEEK_END);
+	long fileSize = std::ftell(file);
+	std::rewind(file);
+	if (fileSize > 0) {
+		data.resize(fileSize);
+		data.resize(std::fread(data.data(), 1, fileSize, file));
+	}
+	std::fclose(file);
+
+	std::shared_ptr<CachedReplay> replay = std::make_shared<CachedReplay>();
+	if (!replayParse(data.data(), data.size(), replay->payload, replay->info, replay->recovered)) {
+		return nullptr;
+	}
+	replay->payload.shrink_to_fit();
+	return replay;
+}
+
+std::shared_ptr<CachedReplay> replayLoadSlot(int slot) {
+	// Normally only the newest save is read, the other file is there in case it turns out damaged
+	uint32_t generation;
+	int newest = replayNewestCopy(slot, generation);
+	int first = newest < 0 ? 0 : newest;
+	std::shared_ptr<CachedReplay> replay = replayLoadFile(replayCopyPath(slot, first));
+	if (replay != nullptr && !replay->recovered) {
+		return replay;
+	}
+	std::shared_ptr<CachedReplay> other = replayLoadFile(replayCopyPath(slot, 1 - first));
+	if (other != nullptr && (!other->recovered || replay == nullptr)) {
+		return other;
+	}
+	return replay;
+}
+
+bool ReplayReader::open(int slot) {
+	close();
+
+	cached = replayCache.get(slot);
+	if (cached != nullptr) {
+		decoder.reset(cached->info);
+		cachedPosition = cached->payload.data();
+		readFailed = false;
+		playhead.reset();
+		running = true;
+		return true;
+	}
+
+	uint32_t generation;
+	int copy = replayNewestCopy(slot, generation);
+	if (copy < 0) {
+		return false;
+	}
+	std::string filePath = replayCopyPath(slot, copy);
+	file = std::fopen(filePath.c_str(), "rb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	std::fseek(file, 0, SEEK_END);
+	long fileSize = std::ftell(file);
+	std::rewind(file);
+	size_t headerSize = std::fread(bytes, 1, sizeof(ReplayHeader), file);
+	info = replayDetectFormat(bytes, headerSize, fileSize < 0 ? 0 : fileSize);
+	if (info.format == REPLAY_FORMAT_BLOCKS) {
+		// Blocks are streamed too, a minute of replay is over 20KB. The trailer
+		// gives the count and CRC up front, so only finished files can be
+		// streamed, and one that was cut off only plays from the cache.
+		uint8_t tail[REPLAY_END_SIZE];
+		size_t tailSize = std::min<size_t>(fileSize < 0 ? 0 : fileSize, sizeof(tail));
+		std::fseek(file, fileSize - tailSize, SEEK_SET);
+		tailSize = std::fread(tail, 1, tailSize, file);
+		ReplayTrailer trailer;
+		if (!replayReadTrailer(bytes, headerSize, tail, tailSize, trailer, generation)) {
+			std::fclose(file);
+			file = nullptr;
+			return false;
+		}
+		info.count = trailer.count;
+		info.payloadSize = trailer.payloadSize;
+		info.crc = trailer.crc;
+	}
+	if (info.format == REPLAY_FORMAT_INVALID || info.count == 0) {
+		std::fclose(file);
+		file = nullptr;
+		return false;
+	}
+	std::fseek(file, info.dataOffset, SEEK_SET);
+	remaining = info.count;
+	decoder.reset(info);
+	bytesStart = 0;
+	bytesEnd = 0;
+
+	emptyChunks = pros::c::sem_create(2, 2);
+	filledChunks = pros::c::sem_create(2, 0);
+	finished = pros::c::sem_create(1, 0);
+	chunkLength[0] = 0;
+	chunkLength[1] = 0;
+	readChunk = 0;
+	readPosition = 0;
+	playhead.reset();
+	stopRequested = false;
+	readFailed = false;
+	running = true;
+
+	pros::c::task_create(fillTask, this, TASK_PRIORITY_DEFAULT, TASK_STACK_DEPTH_DEFAULT, "Replay reader");
+
+	// Playback can start as soon as the first chunk is in
+	if (!pros::c::sem_wait(filledChunks, 1000) || chunkLength[0] == 0) {
+		readFailed = true;
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool ReplayReader::next(Iteration& iteration) {
+	if (!running) {
+		return false;
+	}
+	if (cached != nullptr) {
+		// The cache already checked the CRC, so this can only end or fail on a bug
+		const uint8_t* end = cached->payload.data() + cached->payload.size();
+		return decoder.next(iteration, cachedPosition, end) == DECODE_OK;
+	}
+	if (readPosition >= chunkLength[readChunk]) {
+		if (chunkLength[readChunk] < CHUNK_SIZE) {		// A short chunk is the end of the file
+			return false;
+		}
+		pros::c::sem_post(emptyChunks);		// Hands the finished chunk back to be refilled
+		readChunk ^= 1;
+		readPosition = 0;
+		if (!pros::c::sem_wait(filledChunks, 100)) {
+			readFailed = true;		// The SD card has fallen too far behind
+			return false;
+		}
+		if (chunkLength[readChunk] == 0) {
+			return false;
+		}
+	}
+	iteration = chunks[readChunk][readPosition];
+	readPosition++;
+	return true;
+}
+
+bool ReplayReader::at(uint64_t elapsedUs, Iteration& iteration) {
+	return playhead.at(elapsedUs, tickMs(), iteration, [this](Iteration& following) { return next(following); });
+}
+
+uint16_t ReplayReader::tickMs() const {
+	uint16_t tickMs = cached != nullptr ? cached->info.tickMs : info.tickMs;
+	return tickMs > 0 ? tickMs : 20;
+}
+
+bool ReplayReader::hasTrajectory() const {
+	return (cached != nullptr ? cached->info.channels : info.channels) == 8;
+}
+
+void ReplayReader::close() {
+	if (!running) {
+		return;
+	}
+	if (cached != nullptr) {
+		cached.reset();
+		running = false;
+		return;
+	}
+	stopRequested = true;
+	pros::c::sem_post(emptyChunks);		// Wakes the background task if it is waiting for a chunk
+	pros::c::sem_wait(finished, TIMEOUT_MAX);
+
+	pros::c::sem_delete(emptyChunks);
+	pros::c::sem_delete(filledChunks);
+	pros::c::sem_delete(finished);
+	emptyChunks = nullptr;
+	filledChunks = nullptr;
+	finished = nullptr;
+	running = false;
+}
+
+bool ReplayReader::failed() const {
+	return readFailed;
+}
+
+size_t ReplayReader::fillChunk(Iteration* chunk) {
+	size_t elementsWanted = std::min<uint32_t>(CHUNK_SIZE, remaining);
+	size_t elementsRead = 0;
+
+	if (info.format == REPLAY_FORMAT_LEGACY || info.format == REPLAY_FORMAT_RAW) {
+		// Raw iterations are smaller than Iteration, so they go through the byte window
+		RawIteration* raw = reinterpret_cast<RawIteration*>(bytes);
+		const size_t batchSize = sizeof(bytes) / sizeof(RawIteration);
+		while (elementsRead < elementsWanted) {
+			size_t batchRead = std::fread(raw, sizeof(RawIteration), std::min(batchSize, elementsWanted - elementsRead), file);
+			for (size_t i = 0; i < batchRead; i++) {
+				chunk[elementsRead++] = replayFromRaw(raw[i]);
+			}
+			if (batchRead == 0) {
+				readFailed = true;
+				break;
+			}
+		}
+	} else {
+		while (elementsRead < elementsWanted) {
+			const uint8_t* position = bytes + bytesStart;
+			DecodeResult result = decoder.next(chunk[elementsRead], position, bytes + bytesEnd);
+			bytesStart = position - bytes;
+			if (result == DECODE_OK) {
+				elementsRead++;
+			} else if (result == DECODE_NEED_BYTES) {
+				// Moves the unread bytes to the front and tops the window up
+				std::memmove(bytes, bytes + bytesStart, bytesEnd - bytesStart);
+				bytesEnd -= bytesStart;
+				bytesStart = 0;
+				bool topped;
+				if (info.format == REPLAY_FORMAT_BLOCKS) {
+					topped = readBlock();
+				} else {
+					size_t bytesRead = std::fread(bytes + bytesEnd, 1, sizeof(bytes) - bytesEnd, file);
+					bytesEnd += bytesRead;
+					topped = bytesRead > 0;
+				}
+				if (!topped) {
+					readFailed = true;
+					break;
+				}
+			} else {
+				readFailed = true;
+				break;
+			}
+		}
+		if (elementsRead == remaining && !decoder.verified()) {
+			readFailed = true;		// Every iteration is out but the CRC does not match
+		}
+	}
+
+	remaining -= elementsRead;
+	return elementsRead;
+}
+
+bool ReplayReader::readBlock() {
+	// Checked whole before any of it is decoded, so a damaged block never reaches the motors
+	ReplayBlockHeader block;
+	if (std::fread(&block, sizeof(block), 1, file) != 1 || block.reserved != 0 || block.size > REPLAY_MAX_BLOCK_SIZE ||
+	    std::fread(bytes + bytesEnd, 1, block.size, file) != block.size ||
+	    replayMakeBlock(bytes + bytesEnd, block.size, block.endTick).crc != block.crc) {
+		return false;
+	}
+	bytesEnd += block.size;
+	return true;
+}
+
+void ReplayReader::fillTask(void* param) {
+	ReplayReader* reader = static_cast<ReplayReader*>(param);
+	int writeChunk = 0;
+
+	while (true) {
+		pros::c::sem_wait(reader->emptyChunks, TIMEOUT_MAX);
+		if (reader->stopRequested) {
+			break;
+		}
+		size_t elementsRead = reader->fillChunk(reader->chunks[writeChunk]);
+		reader->chunkLength[writeChunk] = elementsRead;
+		pros::c::sem_post(reader->filledChunks);
+		if (elementsRead < CHUNK_SIZE) {
+			break;		// End of the file
+		}
+		writeChunk ^= 1;
+	}
+
+	std::fclose(reader->file);
+	reader->file = nullptr;
+	pros::c::sem_post(reader->finished);
+}
+
+ReplayCache replayCache;
+
+void ReplayCache::start() {
+	if (reloads != nullptr) {
+		return;
+	}
+	mutex = pros::c::mutex_create();
+	reloads = pros::c::queue_create(REPLAY_SLOT_COUNT, sizeof(int));
+	for (int slot = 0; slot < REPLAY_SLOT_COUNT; slot++) {
+		pros::c::queue_append(reloads, &slot, 0);
+	}
+	pros::c::task_create(loadTask, this, TASK_PRIORITY_MIN + 1, TASK_STACK_DEPTH_DEFAULT, "Replay cache");
+}
+
+void ReplayCache::reload(int slot) {
+	if (reloads != nullptr) {
+		pros::c::queue_append(reloads, &slot, 0);
+	}
+}
+
+std::shared_ptr<const CachedReplay> ReplayCache::get(int slot) {
+	if (mutex == nullptr || slot < 0 || slot >= REPLAY_SLOT_COUNT) {
+		return nullptr;
+	}
+	pros::c::mutex_take(mutex, TIMEOUT_MAX);
+	std::shared_ptr<const CachedReplay> replay = slots[slot];
+	pros::c::mutex_give(mutex);
+	return replay;
+}
+
+std::string ReplayCache::validSlotsText() {
+	std::string text = "Slots";
+	for (int slot = 0; slot < REPLAY_SLOT_COUNT; slot++) {
+		std::shared_ptr<const CachedReplay> replay = get(slot);
+		if (replay == nullptr) {
+			text += " -";
+		} else {
+			text += " " + std::to_string(slot) + (replay->recovered ? "*" : "");
+		}
+	}
+	return text;
+}
+
+void ReplayCache::store(int slot, std::shared_ptr<const CachedReplay> replay) {
+	pros::c::mutex_take(mutex, TIMEOUT_MAX);
+	slots[slot].swap(replay);
+	pros::c::mutex_give(mutex);
+	// The old copy is freed here, outside the lock, unless a reader still holds it
+}
+
+std::shared_ptr<const CachedReplay> ReplayCache::load(int slot) {
+	return replayLoadSlot(slot);
+}
+
+void ReplayCache::loadTask(void* param) {
+	ReplayCache* cache = static_cast<ReplayCache*>(param);
+	int slot;
+
+	while (true) {
+		pros::c::queue_recv(cache->reloads, &slot, TIMEOUT_MAX);
+		cache->store(slot, load(slot));
+		display.set(5, cache->validSlotsText().c_str());
+	}
+}
+
+ReplayRecorder replayRecorder;
+
+void ReplayRecorder::start() {
+	if (commands != nullptr) {
+		return;
+	}
+	commands = pros::c::queue_create(2, sizeof(Command));
+	results = pros::c::queue_create(4, sizeof(SaveResult));
+	pros::c::task_create(recordTask, this, TASK_PRIORITY_MIN + 1, TASK_STACK_DEPTH_DEFAULT, "Replay recorder");
+}
+
+bool ReplayRecorder::begin(int slot, uint16_t tickMs, const ReplayDriverInfo& driver) {
+	if (commands == nullptr || recording) {
+		return false;
+	}
+	Command command = {COMMAND_BEGIN, slot, tickMs, driver};
+	ring.clearOverruns();
+	recording = true;
+	if (!pros::c::queue_append(commands, &command, 0)) {
+		recording = false;
+		return false;
+	}
+	return true;
+}
+
+void ReplayRecorder::record(const Iteration& iteration, uint64_t timeUs) {
+	ring.push({timeUs, iteration});		// Dropped and counted if the recorder task has fallen a whole ring behind
+}
+
+void ReplayRecorder::finish() {
+	Command command = {COMMAND_FINISH, 0, 0, {}};
+	pros::c::queue_append(commands, &command, 0);
+}
+
+bool ReplayRecorder::busy() const {
+	return recording;
+}
+
+bool ReplayRecorder::poll(SaveResult& result) {
+	if (results == nullptr) {
+		return false;
+	}
+	return pros::c::queue_recv(results, &result, 0);
+}
+
+void ReplayRecorder::drain(bool all) {
+	while (ring.size() >= (all ? 1 : DRAIN_SIZE)) {
+		// Encodes up to the end of the ring in one go, the rest is picked up next pass
+		const TimedIteration* samples;
+		size_t count = ring.front(samples);
+		for (size_t i = 0; i < count; i++) {
+			resample(samples[i]);
+		}
+		ring.consume(count);
+	}
+	if (encodedSize > 0 && encoder.count() - lastBlockTick >= BLOCK_TICKS) {
+		flush();
+	}
+}
+
+void ReplayRecorder::resample(const TimedIteration& sample) {
+	if (!haveSample) {
+		nextTickUs = sample.timeUs;		// The grid starts at the first sample
+		heldSample = sample;
+		haveSample = true;
+		return;
+	}
+	// Every grid point before this sample gets whatever was commanded at that time
+	while (nextTickUs < sample.timeUs) {
+		encode(heldSample.iteration);
+		nextTickUs += tickUs;
+	}
+	heldSample = sample;
+}
+
+void ReplayRecorder::encode(const Iteration& iteration) {
+	if (encodedSize + ReplayEncoder::MAX_EVENT_SIZE > sizeof(encoded)) {
+		flush();
+	}
+	encodedSize += encoder.add(iteration, encoded + encodedSize);
+}
+
+void ReplayRecorder::flush() {
+	ReplayBlockHeader block = replayMakeBlock(encoded, encodedSize, encoder.count());
+	if (file != nullptr && encodedSize > 0) {
+		// Flushed straight away so the block survives the power being cut
+		if (std::fwrite(&block, sizeof(block), 1, file) != 1 ||
+		    std::fwrite(encoded, 1, encodedSize, file) != encodedSize || std::fflush(file) != 0) {
+			result.status = SAVE_FAILED_WRITE;
+			std::fclose(file);
+			file = nullptr;
+		}
+	}
+	encodedSize = 0;
+	lastBlockTick = encoder.count();
+}
+
+void ReplayRecorder::recordTask(void* param) {
+	ReplayRecorder* recorder = static_cast<ReplayRecorder*>(param);
+	Command command;
+
+	while (true) {
+		if (pros::c::queue_recv(recorder->commands, &command, 100)) {
+			if (command.type == COMMAND_BEGIN) {
+				recorder->result = {command.slot, SAVE_SUCCESS, 0, 0, 0};
+				recorder->encoder.reset(command.tickMs, true, command.driver);
+				recorder->encodedSize = 0;
+				recorder->lastBlockTick = 0;
+				recorder->tickUs = command.tickMs * 1000;
+				recorder->haveSample = false;
+				// Records over the older of the slot's files, so its newest save is untouched until this one is finished
+				uint32_t generation;
+				recorder->copy = replayNewestCopy(command.slot, generation) == 0 ? 1 : 0;
+				recorder->generation = generation + 1;
+				recorder->file = std::fopen(replayCopyPath(command.slot, recorder->copy).c_str(), "wb");
+				ReplayHeader header = recorder->encoder.header();
+				ReplayDriverInfo driver = recorder->encoder.driverInfo();
+				if (recorder->file == nullptr) {
+					recorder->result.status = SAVE_FAILED_OPEN;
+				} else if (std::fwrite(&header, sizeof(header), 1, recorder->file) != 1 ||
+				           (header.version == REPLAY_VERSION && std::fwrite(&driver, sizeof(driver), 1, recorder->file) != 1)) {
+					recorder->result.status = SAVE_FAILED_WRITE;
+					std::fclose(recorder->file);
+					recorder->file = nullptr;
+				}
+				recorder->active = true;
+			} else if (command.type == COMMAND_FINISH && recorder->active) {
+				recorder->drain(true);
+				if (recorder->haveSample) {
+					// The last sample covers the grid up to and including its own time
+					while (recorder->nextTickUs <= recorder->heldSample.timeUs) {
+						recorder->encode(recorder->heldSample.iteration);
+						recorder->nextTickUs += recorder->tickUs;
+					}
+				}
+				if (recorder->encodedSize > 0) {
+					recorder->flush();
+				}
+				ReplayTrailer trailer = recorder->encoder.trailer();
+				recorder->result.count = trailer.count;
+				recorder->result.bytes = trailer.payloadSize;
+				if (recorder->file != nullptr) {
+					// The generation goes last, the save only counts once it is on the card
+					ReplayGeneration generation = replayMakeGeneration(trailer, recorder->generation);
+					if (std::fwrite(&trailer, sizeof(trailer), 1, recorder->file) != 1 ||
+					    std::fwrite(&generation, sizeof(generation), 1, recorder->file) != 1) {
+						recorder->result.status = SAVE_FAILED_WRITE;
+					}
+					std::fclose(recorder->file);
+					recorder->file = nullptr;
+				}
+
+				// Only a file that reads back whole becomes the slot's replay
+				std::string filePath = replayCopyPath(recorder->result.slot, recorder->copy);
+				if (recorder->result.status == SAVE_SUCCESS) {
+					std::shared_ptr<CachedReplay> saved = replayLoadFile(filePath);
+					if (saved == nullptr || saved->recovered || saved->info.generation != recorder->generation) {
+						recorder->result.status = SAVE_FAILED_WRITE;
+					}
+				}
+				if (recorder->result.status == SAVE_FAILED_WRITE) {
+					// Emptied, as the card cannot delete, so a bad save can never outrank the last good one
+					FILE* failed = std::fopen(filePath.c_str(), "wb");
+					if (failed != nullptr) {
+						std::fclose(failed);
+					}
+				}
+				recorder->result.dropped = recorder->ring.overruns();
+				recorder->active = false;
+				pros::c::queue_append(recorder->results, &recorder->result, 0);
+				recorder->recording = false;
+			}
+		}
+		if (recorder->active) {
+			recorder->drain(false);
+		}
+	}
+}
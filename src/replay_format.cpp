@@ -0,0 +1,435 @@
+#include "replay_format.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace {
+// Channels in mask bit order. The goal clamp is a toggle with no delta.
+enum Channel {
+	CHANNEL_LEFT,
+	CHANNEL_RIGHT,
+	CHANNEL_INTAKE,
+	CHANNEL_GOAL_CLAMP,
+	CHANNEL_LEFT_POSITION,
+	CHANNEL_RIGHT_POSITION,
+	CHANNEL_LEFT_VELOCITY,
+	CHANNEL_RIGHT_VELOCITY
+};
+
+int32_t channelValue(const Iteration& iteration, int channel) {
+	switch (channel) {
+		case CHANNEL_LEFT: return iteration.left;
+		case CHANNEL_RIGHT: return iteration.right;
+		case CHANNEL_INTAKE: return iteration.intake;
+		case CHANNEL_GOAL_CLAMP: return iteration.goalClamp;
+		case CHANNEL_LEFT_POSITION: return iteration.leftPosition;
+		case CHANNEL_RIGHT_POSITION: return iteration.rightPosition;
+		case CHANNEL_LEFT_VELOCITY: return iteration.leftVelocity;
+		case CHANNEL_RIGHT_VELOCITY: return iteration.rightVelocity;
+	}
+	return 0;
+}
+
+void applyDelta(Iteration& iteration, int channel, int32_t delta) {
+	switch (channel) {
+		case CHANNEL_LEFT: iteration.left += delta; break;
+		case CHANNEL_RIGHT: iteration.right += delta; break;
+		case CHANNEL_INTAKE: iteration.intake += delta; break;
+		case CHANNEL_GOAL_CLAMP: iteration.goalClamp = !iteration.goalClamp; break;
+		case CHANNEL_LEFT_POSITION: iteration.leftPosition += delta; break;
+		case CHANNEL_RIGHT_POSITION: iteration.rightPosition += delta; break;
+		case CHANNEL_LEFT_VELOCITY: iteration.leftVelocity += delta; break;
+		case CHANNEL_RIGHT_VELOCITY: iteration.rightVelocity += delta; break;
+	}
+}
+
+enum VarintResult {
+	VARINT_OK,
+	VARINT_SHORT,	// Ran out of bytes part way through
+	VARINT_BAD		// Longer than any value we write
+};
+
+size_t writeVarint(uint32_t value, uint8_t* out) {
+	size_t length = 0;
+	while (value >= 0x80) {
+		out[length++] = uint8_t(value) | 0x80;
+		value >>= 7;
+	}
+	out[length++] = uint8_t(value);
+	return length;
+}
+
+VarintResult readVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (data == end) {
+			return VARINT_SHORT;
+		}
+		uint8_t byte = *data++;
+		value |= uint32_t(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return VARINT_OK;
+		}
+	}
+	return VARINT_BAD;
+}
+
+uint32_t zigzag(int32_t value) {
+	return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value) {
+	return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+}  // namespace
+
+ReplayInfo replayDetectFormat(const uint8_t* data, size_t size, size_t fileSize) {
+	ReplayInfo info = {REPLAY_FORMAT_INVALID, 0, 0, 0, 0, 20, 4, {}, 0};
+	uint32_t magic = 0;
+	if (size >= sizeof(magic)) {
+		std::memcpy(&magic, data, sizeof(magic));
+	}
+
+	if (magic == REPLAY_MAGIC && size >= sizeof(ReplayHeader)) {
+		ReplayHeader header;
+		std::memcpy(&header, data, sizeof(header));
+		info.tickMs = header.tickMs;
+		info.dataOffset = sizeof(header);
+		if (header.version == REPLAY_VERSION || header.version == REPLAY_VERSION_NO_GENERATION ||
+		    header.version == REPLAY_VERSION_NO_DRIVER_INFO || header.version == REPLAY_VERSION_NO_TRAJECTORY) {
+			info.format = REPLAY_FORMAT_BLOCKS;		// The count is only known once the blocks are unpacked
+			info.channels = header.version == REPLAY_VERSION_NO_TRAJECTORY ? 4 : 8;
+			if (header.version == REPLAY_VERSION || header.version == REPLAY_VERSION_NO_GENERATION) {
+				if (size >= sizeof(header) + sizeof(ReplayDriverInfo)) {
+					std::memcpy(&info.driver, data + sizeof(header), sizeof(ReplayDriverInfo));
+				}
+				info.dataOffset += sizeof(ReplayDriverInfo);
+			}
+			return info;
+		}
+		if (header.version != REPLAY_VERSION_UNBLOCKED || header.count == REPLAY_COUNT_UNFINISHED ||
+		    header.payloadSize > fileSize - sizeof(header)) {
+			return info;
+		}
+		info.format = REPLAY_FORMAT_ENCODED;
+		info.count = header.count;
+		info.payloadSize = header.payloadSize;
+		info.crc = header.crc;
+	} else if (magic == REPLAY_MAGIC_RAW && size >= sizeof(RawReplayHeader)) {
+		RawReplayHeader header;
+		std::memcpy(&header, data, sizeof(header));
+		uint32_t available = (fileSize - sizeof(header)) / sizeof(RawIteration);
+		info.format = REPLAY_FORMAT_RAW;
+		info.count = header.count < available ? header.count : available;	// Also covers unfinished recordings
+		info.dataOffset = sizeof(header);
+	} else if (fileSize >= sizeof(RawIteration)) {
+		// A legacy file cut short still plays up to where it was cut
+		info.format = REPLAY_FORMAT_LEGACY;
+		info.count = fileSize < REPLAY_LEGACY_SIZE ? fileSize / sizeof(RawIteration) : REPLAY_LEGACY_COUNT;
+	}
+	return info;
+}
+
+uint32_t replayCrc32(uint32_t crc, const uint8_t* data, size_t size) {
+	static const uint32_t table[16] = {
+		0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+		0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+	};
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++) {
+		crc = (crc >> 4) ^ table[(crc ^ data[i]) & 0x0F];
+		crc = (crc >> 4) ^ table[(crc ^ (data[i] >> 4)) & 0x0F];
+	}
+	return ~crc;
+}
+
+ReplayBlockHeader replayMakeBlock(const uint8_t* events, uint16_t size, uint32_t endTick) {
+	uint32_t crc = replayCrc32(0, reinterpret_cast<const uint8_t*>(&endTick), sizeof(endTick));
+	return {size, 0, endTick, replayCrc32(crc, events, size)};
+}
+
+ReplayGeneration replayMakeGeneration(const ReplayTrailer& trailer, uint32_t generation) {
+	uint32_t crc = replayCrc32(0, reinterpret_cast<const uint8_t*>(&trailer), sizeof(trailer));
+	return {generation, replayCrc32(crc, reinterpret_cast<const uint8_t*>(&generation), sizeof(generation))};
+}
+
+bool replayFileGeneration(const uint8_t* head, size_t headSize, const uint8_t* tail, size_t tailSize, uint32_t& generation) {
+	generation = 0;
+	if (headSize == 0) {
+		return false;
+	}
+	ReplayHeader header;
+	if (headSize < sizeof(header)) {
+		return true;
+	}
+	std::memcpy(&header, head, sizeof(header));
+	if (header.magic != REPLAY_MAGIC || header.version != REPLAY_VERSION) {
+		return true;
+	}
+	ReplayTrailer trailer;
+	return replayReadTrailer(head, headSize, tail, tailSize, trailer, generation);
+}
+
+bool replayReadTrailer(const uint8_t* head, size_t headSize, const uint8_t* tail, size_t tailSize, ReplayTrailer& trailer, uint32_t& generation) {
+	generation = 0;
+	if (replayDetectFormat(head, headSize, headSize).format != REPLAY_FORMAT_BLOCKS) {
+		return false;
+	}
+	ReplayHeader header;
+	std::memcpy(&header, head, sizeof(header));
+	size_t endSize = header.version == REPLAY_VERSION ? REPLAY_END_SIZE : sizeof(ReplayTrailer);
+	if (tailSize < endSize) {
+		return false;
+	}
+	std::memcpy(&trailer, tail + tailSize - endSize, sizeof(trailer));
+	if (trailer.magic != REPLAY_TRAILER_MAGIC) {
+		return false;
+	}
+	if (header.version == REPLAY_VERSION) {
+		ReplayGeneration saved;
+		std::memcpy(&saved, tail + tailSize - sizeof(saved), sizeof(saved));
+		if (replayMakeGeneration(trailer, saved.generation).crc != saved.crc) {
+			return false;
+		}
+		generation = saved.generation;
+	}
+	return true;
+}
+
+bool replayUnpackBlocks(const uint8_t* data, size_t size, std::vector<uint8_t>& events, ReplayInfo& info) {
+	info = replayDetectFormat(data, size, size);
+	events.clear();
+	if (info.format != REPLAY_FORMAT_BLOCKS) {
+		return false;
+	}
+	ReplayHeader header;
+	std::memcpy(&header, data, sizeof(header));
+
+	size_t offset = info.dataOffset;
+	uint32_t count = 0;
+	uint32_t crc = 0;
+	bool complete = false;
+	while (size - offset >= sizeof(ReplayBlockHeader)) {
+		uint32_t magic;
+		std::memcpy(&magic, data + offset, sizeof(magic));
+		if (magic == REPLAY_TRAILER_MAGIC) {
+			ReplayTrailer trailer;
+			if (size - offset >= sizeof(trailer)) {
+				std::memcpy(&trailer, data + offset, sizeof(trailer));
+				complete = trailer.count >= count && trailer.payloadSize == events.size() && trailer.crc == crc;
+				if (complete && header.version == REPLAY_VERSION) {
+					// Without its generation the save never finished, however whole the rest looks
+					ReplayGeneration saved;
+					complete = size - offset >= REPLAY_END_SIZE;
+					if (complete) {
+						std::memcpy(&saved, data + offset + sizeof(trailer), sizeof(saved));
+						complete = replayMakeGeneration(trailer, saved.generation).crc == saved.crc;
+						info.generation = complete ? saved.generation : 0;
+					}
+				}
+				if (complete) {
+					count = trailer.count;		// Iterations after the last block with no changes
+				}
+			}
+			break;
+		}
+
+		ReplayBlockHeader block;
+		std::memcpy(&block, data + offset, sizeof(block));
+		const uint8_t* blockEvents = data + offset + sizeof(block);
+		if (block.reserved != 0 || block.size > REPLAY_MAX_BLOCK_SIZE || block.size > size - offset - sizeof(block) ||
+		    block.endTick < count || replayMakeBlock(blockEvents, block.size, block.endTick).crc != block.crc) {
+			break;		// Damaged, keeps everything before it
+		}
+		events.insert(events.end(), blockEvents, blockEvents + block.size);
+		crc = replayCrc32(crc, blockEvents, block.size);
+		count = block.endTick;
+		offset += sizeof(block) + block.size;
+	}
+
+	info.format = REPLAY_FORMAT_ENCODED;
+	info.count = count;
+	info.dataOffset = 0;
+	info.payloadSize = events.size();
+	info.crc = crc;
+	return complete;
+}
+
+bool replayParse(const uint8_t* data, size_t size, std::vector<uint8_t>& payload, ReplayInfo& info, bool& recovered) {
+	info = replayDetectFormat(data, size, size);
+	payload.clear();
+	recovered = false;
+	if (info.format == REPLAY_FORMAT_BLOCKS) {
+		// Anything after a damaged block is dropped, the rest still plays
+		recovered = !replayUnpackBlocks(data, size, payload, info);
+	} else if (info.format == REPLAY_FORMAT_ENCODED) {
+		const uint8_t* events = data + info.dataOffset;
+		payload.assign(events, events + info.payloadSize);
+		info.dataOffset = 0;
+	} else if (info.format == REPLAY_FORMAT_LEGACY || info.format == REPLAY_FORMAT_RAW) {
+		// Raw iterations are re-encoded, which also shrinks them a lot
+		ReplayEncoder encoder;
+		encoder.reset(info.tickMs, false);
+		uint8_t event[ReplayEncoder::MAX_EVENT_SIZE];
+		for (uint32_t i = 0; i < info.count; i++) {
+			RawIteration raw;
+			std::memcpy(&raw, data + info.dataOffset + i * sizeof(RawIteration), sizeof(RawIteration));
+			size_t length = encoder.add(replayFromRaw(raw), event);
+			payload.insert(payload.end(), event, event + length);
+		}
+		ReplayTrailer trailer = encoder.trailer();
+		info = {REPLAY_FORMAT_ENCODED, trailer.count, 0, trailer.payloadSize, trailer.crc, info.tickMs, 4, {}, 0};
+	}
+	if (info.format != REPLAY_FORMAT_ENCODED || info.count == 0) {
+		return false;
+	}
+
+	// Decodes the whole stream once so a bad CRC is caught now rather than mid-replay
+	ReplayDecoder decoder;
+	decoder.reset(info);
+	const uint8_t* position = payload.data();
+	const uint8_t* end = position + payload.size();
+	Iteration iteration;
+	while (decoder.next(iteration, position, end) == DECODE_OK) {}
+	return decoder.verified();
+}
+
+Iteration replayFromRaw(const RawIteration& raw) {
+	return {raw.left, raw.right, raw.intake, raw.goalClamp, 0, 0, 0, 0};
+}
+
+Iteration replayInterpolate(const Iteration& a, const Iteration& b, float fraction) {
+	Iteration iteration = a;
+	iteration.left = a.left + int16_t(std::lround((b.left - a.left) * fraction));
+	iteration.right = a.right + int16_t(std::lround((b.right - a.right) * fraction));
+	iteration.leftPosition = a.leftPosition + int32_t(std::lround((b.leftPosition - a.leftPosition) * fraction));
+	iteration.rightPosition = a.rightPosition + int32_t(std::lround((b.rightPosition - a.rightPosition) * fraction));
+	iteration.leftVelocity = a.leftVelocity + int16_t(std::lround((b.leftVelocity - a.leftVelocity) * fraction));
+	iteration.rightVelocity = a.rightVelocity + int16_t(std::lround((b.rightVelocity - a.rightVelocity) * fraction));
+	return iteration;
+}
+
+void ReplayEncoder::reset(uint16_t tickMs, bool trajectory, const ReplayDriverInfo& driver) {
+	last = {0, 0, 0, false, 0, 0, 0, 0};
+	this->tickMs = tickMs;
+	channels = trajectory ? 8 : 4;
+	this->driver = driver;
+	iterations = 0;
+	lastEventTick = 0;
+	payloadSize = 0;
+	crc = 0;
+}
+
+size_t ReplayEncoder::add(const Iteration& iteration, uint8_t* out) {
+	uint8_t mask = 0;
+	for (int channel = 0; channel < channels; channel++) {
+		if (channelValue(iteration, channel) != channelValue(last, channel)) {
+			mask |= 1 << channel;
+		}
+	}
+
+	size_t length = 0;
+	if (mask != 0) {
+		length += writeVarint((iterations - lastEventTick) << channels | mask, out);
+		for (int channel = 0; channel < channels; channel++) {
+			if ((mask & (1 << channel)) && channel != CHANNEL_GOAL_CLAMP) {
+				length += writeVarint(zigzag(channelValue(iteration, channel) - channelValue(last, channel)), out + length);
+			}
+		}
+		crc = replayCrc32(crc, out, length);
+		payloadSize += length;
+		lastEventTick = iterations;
+	}
+	last = iteration;
+	iterations++;
+	return length;
+}
+
+uint32_t ReplayEncoder::count() const {
+	return iterations;
+}
+
+ReplayHeader ReplayEncoder::header() const {
+	uint16_t version = channels == 8 ? REPLAY_VERSION : REPLAY_VERSION_NO_TRAJECTORY;
+	return {REPLAY_MAGIC, version, tickMs, REPLAY_COUNT_UNFINISHED, 0, 0};
+}
+
+ReplayDriverInfo ReplayEncoder::driverInfo() const {
+	return driver;
+}
+
+ReplayTrailer ReplayEncoder::trailer() const {
+	return {REPLAY_TRAILER_MAGIC, iterations, payloadSize, crc};
+}
+
+void ReplayDecoder::reset(const ReplayInfo& info) {
+	current = {0, 0, 0, false, 0, 0, 0, 0};
+	havePending = false;
+	channels = info.channels;
+	tick = 0;
+	count = info.count;
+	nextEventTick = 0;
+	lastEventTick = 0;
+	payloadLeft = info.payloadSize;
+	expectedCrc = info.crc;
+	crc = 0;
+}
+
+DecodeResult ReplayDecoder::next(Iteration& iteration, const uint8_t*& data, const uint8_t* end) {
+	if (tick >= count) {
+		return DECODE_END;
+	}
+
+	if (!havePending && payloadLeft > 0) {
+		// Never reads past the payload, even if the caller has more bytes
+		const uint8_t* payloadEnd = size_t(end - data) > payloadLeft ? data + payloadLeft : end;
+		const uint8_t* position = data;
+		bool lastBytes = payloadEnd == data + payloadLeft;
+
+		uint32_t eventHeader;
+		uint32_t value;
+		VarintResult result = readVarint(position, payloadEnd, eventHeader);
+		pending.mask = eventHeader & ((1 << channels) - 1);
+		for (int channel = 0; channel < channels && result == VARINT_OK; channel++) {
+			pending.deltas[channel] = 0;
+			if ((pending.mask & (1 << channel)) && channel != CHANNEL_GOAL_CLAMP) {
+				result = readVarint(position, payloadEnd, value);
+				pending.deltas[channel] = unzigzag(value);
+			}
+		}
+		if (result == VARINT_SHORT && !lastBytes) {
+			return DECODE_NEED_BYTES;
+		}
+		if (result != VARINT_OK || pending.mask == 0) {
+			return DECODE_ERROR;
+		}
+
+		// Events are strictly after the last one, except the first which may be on tick 0
+		nextEventTick = lastEventTick + (eventHeader >> channels);
+		if (nextEventTick < tick || nextEventTick >= count) {
+			return DECODE_ERROR;
+		}
+
+		crc = replayCrc32(crc, data, position - data);
+		payloadLeft -= position - data;
+		data = position;
+		havePending = true;
+	}
+
+	if (havePending && nextEventTick == tick) {
+		for (int channel = 0; channel < channels; channel++) {
+			if (pending.mask & (1 << channel)) {
+				applyDelta(current, channel, pending.deltas[channel]);
+			}
+		}
+		lastEventTick = tick;
+		havePending = false;
+	}
+
+	iteration = current;
+	tick++;
+	return DECODE_OK;
+}
+
+bool ReplayDecoder::verified() const {
+	return tick == count && payloadLeft == 0 && !havePending && crc == expectedCrc;
+}
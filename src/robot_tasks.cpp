@@ -0,0 +1,236 @@
+#include "main.h"
+#include "robot_tasks.hpp"
+
+#include "controller_output.hpp"
+#include "display.hpp"
+#include "telemetry.hpp"
+
+RobotChannels channels;
+ReplayTask replayTask;
+UiTask uiTask;
+
+std::string replaySlotText(int slot, bool brief) {
+	bool empty = replayCache.get(slot) == nullptr;
+	if (brief) {
+		return "Slot " + std::to_string(slot) + (empty ? " empty" : "");
+	}
+	return "Replay slot: " + std::to_string(slot) + (empty ? " (empty)" : "");
+}
+
+void showTrackingError(const TrajectoryFollower& left, const TrajectoryFollower& right) {
+	display.print(2, "Tracking error max %.0f/%.0f, end %.0f/%.0f deg",
+	              left.maxError(), right.maxError(), left.error(), right.error());
+}
+
+void showLoopReport(const LoopReport& report) {
+	char text[Display::LINE_SIZE];
+	loopReportText(report, text, sizeof(text));
+	display.set(4, text);
+}
+
+void showActuatorStats(const ActuatorStats& stats) {
+	uint32_t total = stats.sent + stats.saved;
+	display.print(6, "Writes %u, saved %u (%u%%)", unsigned(stats.sent), unsigned(stats.saved),
+	              unsigned(total > 0 ? uint64_t(stats.saved) * 100 / total : 0));
+}
+
+void RobotChannels::start() {
+	if (events != nullptr) {
+		return;
+	}
+	events = pros::c::queue_create(EVENT_QUEUE_SIZE, sizeof(ControlEvent));
+	replayState.write({STATUS_DRIVING, 0, 0, 0});
+}
+
+void RobotChannels::send(ControlEvent event) {
+	if (events != nullptr) {
+		pros::c::queue_append(events, &event, 0);
+	}
+}
+
+void RobotChannels::sendSample(const DriverSample& sample) {
+	if (samples.push(sample) && sampleReader != nullptr) {
+		pros::c::task_notify(sampleReader);
+	}
+}
+
+void ReplayTask::start(uint16_t tickMs) {
+	if (started) {
+		return;
+	}
+	started = true;
+	this->tickMs = tickMs;
+	control.setTickMs(tickMs);
+	channels.sampleReader = pros::c::task_create(run, this, REPLAY_TASK_PRIORITY, TASK_STACK_DEPTH_DEFAULT, "Replay control");
+}
+
+void ReplayTask::run(void* param) {
+	ReplayTask* task = static_cast<ReplayTask*>(param);
+	while (true) {
+		// Wakes right after each control tick, or on a timeout so saves are still reported when opcontrol() is not running
+		pros::c::task_notify_take(true, task->tickMs * 2);
+
+		// Presses are sent before the sample of the same tick
+		ControlEvent event;
+		while (pros::c::queue_recv(channels.events, &event, 0)) {
+			task->control.handle(event);
+		}
+		DriverSample sample;
+		while (channels.samples.pop(sample)) {
+			task->control.update(sample);
+		}
+		task->pollSaves();
+		task->publish();
+	}
+}
+
+void ReplayTask::publish() {
+	channels.replayOutput.write(control.output());
+	channels.replayState.write(control.state());
+}
+
+bool ReplayTask::Io::recorderBusy() {
+	return replayRecorder.busy();
+}
+
+bool ReplayTask::Io::beginRecording(int slot, uint16_t tickMs, const ReplayDriverInfo& driver) {
+	if (!replayRecorder.begin(slot, tickMs, driver)) {
+		return false;
+	}
+	telemetryRecorder.begin(slot, tickMs);	// Best effort, the replay is recorded either way
+	recordingOverruns = channels.samples.overruns();
+	return true;
+}
+
+void ReplayTask::Io::record(const Iteration& iteration, uint64_t timeUs) {
+	replayRecorder.record(iteration, timeUs);
+}
+
+void ReplayTask::Io::finishRecording() {
+	// The recorder task writes out the rest of the ring buffer
+	display.set(2, "Saving replay...");
+	missedSamples = channels.samples.overruns() - recordingOverruns;
+	replayRecorder.finish();
+	telemetryRecorder.finish();
+}
+
+bool ReplayTask::Io::openReplay(int slot) {
+	return reader.open(slot);
+}
+
+bool ReplayTask::Io::replayHasTrajectory() {
+	return reader.hasTrajectory();
+}
+
+bool ReplayTask::Io::replayAt(uint64_t timeUs, Iteration& iteration) {
+	return reader.at(timeUs, iteration);
+}
+
+bool ReplayTask::Io::replayFailed() {
+	return reader.failed();
+}
+
+void ReplayTask::Io::closeReplay() {
+	reader.close();
+}
+
+void ReplayTask::Io::message(const char* text) {
+	display.set(2, text);
+}
+
+void ReplayTask::Io::trackingError(const TrajectoryFollower& left, const TrajectoryFollower& right) {
+	showTrackingError(left, right);
+}
+
+void ReplayTask::pollSaves() {
+	SaveResult saveResult;
+	if (replayRecorder.poll(saveResult)) {
+		replayCache.reload(saveResult.slot);	// Even a failed save may have changed the file
+		switch (saveResult.status) {
+			case SAVE_SUCCESS:
+				display.print(2, "Saved %u ticks in %uB, %u dropped, %u missed", unsigned(saveResult.count), unsigned(saveResult.bytes),
+				              unsigned(saveResult.dropped), unsigned(io.missedSamples));
+				break;
+			case SAVE_FAILED_OPEN:
+				display.set(2, "Failed to open file");
+				break;
+			case SAVE_FAILED_WRITE:
+				display.set(2, "Error writing data to file!");
+				break;
+		}
+	}
+}
+
+void UiTask::start() {
+	if (started) {
+		return;
+	}
+	started = true;
+	pros::c::task_create(run, this, UI_TASK_PRIORITY, TASK_STACK_DEPTH_DEFAULT, "Operator UI");
+}
+
+void UiTask::run(void*) {
+	bool wasActive = false;
+	RobotState shown = {};
+	int shownSlot = -1;
+	uint32_t reportVersion = channels.loopReport.version();
+	uint32_t wakeTime = pros::millis();
+
+	while (true) {
+		RobotState robot = channels.robotState.read();
+		uint32_t now = pros::millis();
+		bool active = robot.tickMs != 0 && now - robot.tickMs < 5 * PERIOD_MS;
+
+		// The slot can be changed from the LLEMU buttons in any mode
+		int slot = active ? robot.slot : channels.replayState.read().slot;
+		if (slot != shownSlot || (active && !wasActive)) {
+			display.set(3, replaySlotText(slot).c_str());
+			controllerOutput.print(0, "%s", replaySlotText(slot, true).c_str());
+			shownSlot = slot;
+		}
+
+		if (active) {
+			int32_t countdownLeft = int32_t(robot.countdownEnd - now);
+			switch (robot.status) {
+				case STATUS_DRIVING:
+					display.set(0, "Driving");
+					break;
+				case STATUS_RECORD_COUNTDOWN:
+					display.print(0, "Recording in %.1f seconds", std::max(countdownLeft, int32_t(0)) / 1000.0);
+					break;
+				case STATUS_RECORDING:
+					display.set(0, "Recording, press X to stop");
+					break;
+				case STATUS_REPLAY_COUTNDOWN:
+					display.print(0, "Replaying in %.1f seconds", std::max(countdownLeft, int32_t(0)) / 1000.0);
+					break;
+				case STATUS_REPLAYING:
+					display.set(0, "Replaying");
+					break;
+			}
+			display.print(1, "Time %d", robot.time);
+
+			if (wasActive && robot.driveMode != shown.driveMode) {
+				controllerOutput.print(0, robot.driveMode == DRIVE_MODE_TANK ? "Tank drive" : "Arcade drive");
+			}
+			if (wasActive && robot.status != shown.status) {
+				if (robot.status == STATUS_RECORDING) {
+					controllerOutput.rumble(".");
+				} else if (shown.status == STATUS_RECORDING) {
+					controllerOutput.rumble("..");
+				}
+			}
+			shown = robot;
+		}
+		wasActive = active;
+
+		if (channels.loopReport.version() != reportVersion) {
+			reportVersion = channels.loopReport.version();
+			LoopReport report = channels.loopReport.read();
+			showLoopReport(report);
+			loopStatsLog.publish(report);
+			showActuatorStats(channels.actuatorStats.read());
+		}
+		pros::c::task_delay_until(&wakeTime, PERIOD_MS);
+	}
+}
@@ -0,0 +1,56 @@
+#include "main.h"
+#include "scheduler.hpp"
+
+PeriodicScheduler::PeriodicScheduler(uint32_t periodMs, OverrunPolicy policy)
+    : periodMs(periodMs > 0 ? periodMs : 1), policy(policy) {}
+
+void PeriodicScheduler::start() {
+	lastWake = pros::millis();
+	tickCount = 0;
+	overrunCount = 0;
+	skippedCount = 0;
+}
+
+uint32_t PeriodicScheduler::wait() {
+	tickCount++;
+	uint32_t deadline = lastWake + periodMs;
+	int32_t late = int32_t(pros::millis() - deadline);
+	if (late <= 0) {
+		pros::c::task_delay_until(&lastWake, periodMs);
+		return 0;
+	}
+
+	overrunCount++;
+	uint32_t missed = late / periodMs;
+	switch (policy) {
+		case OVERRUN_SKIP:
+			lastWake = deadline + missed * periodMs;
+			break;
+		case OVERRUN_CATCH_UP:
+			lastWake = deadline;
+			missed = 0;
+			break;
+		case OVERRUN_RESET:
+			lastWake = deadline + late;
+			break;
+	}
+	skippedCount += missed;
+	tickCount += missed;
+	return missed;
+}
+
+uint32_t PeriodicScheduler::period() const {
+	return periodMs;
+}
+
+uint32_t PeriodicScheduler::ticks() const {
+	return tickCount;
+}
+
+uint32_t PeriodicScheduler::overruns() const {
+	return overrunCount;
+}
+
+uint32_t PeriodicScheduler::skipped() const {
+	return skippedCount;
+}
@@ -0,0 +1,228 @@
+#include "telemetry.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "replay.hpp"
+
+TelemetryRecorder telemetryRecorder;
+
+void TelemetryRecorder::addColumn(const std::string& name) {
+	columns.push_back(name);
+}
+
+void TelemetryRecorder::addMotors(const char* name, const std::vector<int8_t>& ports) {
+	if (commands != nullptr || columns.size() + ports.size() * 5 > MAX_COLUMNS) {
+		return;
+	}
+	motors.push_back({std::make_unique<pros::MotorGroup>(ports), ports.size(), int(columns.size())});
+	for (size_t i = 0; i < ports.size(); i++) {
+		std::string motor = std::string(name) + " " + std::to_string(i + 1);
+		addColumn(motor + " current mA");
+		addColumn(motor + " temp 0.1C");
+		addColumn(motor + " voltage mV");
+		addColumn(motor + " velocity rpm");
+		addColumn(motor + " position 0.1deg");
+	}
+}
+
+void TelemetryRecorder::addAdiPort(const char* name, uint8_t port) {
+	if (commands != nullptr || columns.size() >= MAX_COLUMNS) {
+		return;
+	}
+	adiPorts.push_back({port, int(columns.size())});
+	addColumn(name);
+}
+
+void TelemetryRecorder::start() {
+	if (commands != nullptr) {
+		return;
+	}
+	commands = pros::c::queue_create(2, sizeof(Command));
+	emptyBatches = pros::c::sem_create(2, 2);
+	filledBatches = pros::c::sem_create(2, 0);
+	pros::c::task_create(sampleTask, this, TASK_PRIORITY_DEFAULT, TASK_STACK_DEPTH_DEFAULT, "Telemetry sampler");
+	pros::c::task_create(writeTask, this, TASK_PRIORITY_MIN + 1, TASK_STACK_DEPTH_DEFAULT, "Telemetry writer");
+}
+
+bool TelemetryRecorder::begin(int slot, uint16_t tickMs) {
+	if (commands == nullptr || recording) {
+		return false;
+	}
+	Command command = {COMMAND_BEGIN, slot, tickMs};
+	droppedRows = 0;
+	writeFailed = false;
+	recording = true;
+	if (!pros::c::queue_append(commands, &command, 0)) {
+		recording = false;
+		return false;
+	}
+	return true;
+}
+
+void TelemetryRecorder::finish() {
+	Command command = {COMMAND_FINISH, 0, 0};
+	pros::c::queue_append(commands, &command, 0);
+}
+
+bool TelemetryRecorder::busy() const {
+	return recording;
+}
+
+uint32_t TelemetryRecorder::dropped() const {
+	return droppedRows;
+}
+
+bool TelemetryRecorder::failed() const {
+	return writeFailed;
+}
+
+void TelemetryRecorder::sample(Batch& batch, uint32_t elapsedMs) {
+	int row = batch.count;
+	batch.values[0][row] = elapsedMs;
+	batch.values[1][row] = pros::battery::get_voltage();
+	batch.values[2][row] = pros::battery::get_current();
+
+	for (MotorSource& motor : motors) {
+		// Each getter reads the whole group in one call
+		std::vector<int32_t> current = motor.group->get_current_draw_all();
+		std::vector<double> temperature = motor.group->get_temperature_all();
+		std::vector<int32_t> voltage = motor.group->get_voltage_all();
+		std::vector<double> velocity = motor.group->get_actual_velocity_all();
+		std::vector<double> position = motor.group->get_position_all();
+		size_t count = std::min({motor.count, current.size(), temperature.size(), voltage.size(), velocity.size(), position.size()});
+		for (size_t i = 0; i < count; i++) {
+			int32_t* column = &batch.values[motor.firstColumn + i * 5][row];
+			column[0] = current[i];
+			column[BATCH_SIZE] = std::lround(temperature[i] * 10);
+			column[BATCH_SIZE * 2] = voltage[i];
+			column[BATCH_SIZE * 3] = std::lround(velocity[i]);
+			column[BATCH_SIZE * 4] = std::lround(position[i] * 10);
+		}
+	}
+
+	for (const AdiSource& adi : adiPorts) {
+		batch.values[adi.column][row] = pros::c::adi_port_get_value(adi.port);
+	}
+	batch.count = row + 1;
+}
+
+bool TelemetryRecorder::write(const Batch& batch) {
+	TelemetryBatchHeader header = {TELEMETRY_BATCH_MAGIC, batch.count, 0, 0};
+	for (size_t column = 0; column < columns.size(); column++) {
+		header.crc = replayCrc32(header.crc, reinterpret_cast<const uint8_t*>(batch.values[column]), batch.count * sizeof(int32_t));
+	}
+	if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+		return false;
+	}
+	for (size_t column = 0; column < columns.size(); column++) {
+		if (std::fwrite(batch.values[column], sizeof(int32_t), batch.count, file) != batch.count) {
+			return false;
+		}
+	}
+	// Flushed so everything up to the last batch survives the power being cut
+	return std::fflush(file) == 0;
+}
+
+void TelemetryRecorder::sampleTask(void* param) {
+	TelemetryRecorder* recorder = static_cast<TelemetryRecorder*>(param);
+	Command command;
+	int fill = 0;		// Batches are filled and written in turn, across recordings too
+
+	while (true) {
+		if (!pros::c::queue_recv(recorder->commands, &command, TIMEOUT_MAX) || command.type != COMMAND_BEGIN) {
+			continue;
+		}
+		int slot = command.slot;
+		uint16_t tickMs = command.tickMs > 0 ? command.tickMs : 20;
+
+		// Both batches are free by now, begin() waits for the last recording to be written
+		pros::c::sem_wait(recorder->emptyBatches, TIMEOUT_MAX);
+		Batch* batch = &recorder->batches[fill];
+		*batch = {};
+		batch->slot = slot;
+		batch->tickMs = tickMs;
+		batch->first = true;
+
+		uint32_t startTime = pros::millis();
+		uint32_t wakeTime = startTime;
+		bool finishing = false;
+		while (!finishing) {
+			if (batch != nullptr) {
+				recorder->sample(*batch, pros::millis() - startTime);
+			} else {
+				recorder->droppedRows = recorder->droppedRows + 1;
+			}
+			finishing = pros::c::queue_recv(recorder->commands, &command, 0) && command.type == COMMAND_FINISH;
+
+			if (batch != nullptr && (batch->count == BATCH_SIZE || finishing)) {
+				batch->last = finishing;
+				pros::c::sem_post(recorder->filledBatches);
+				fill = 1 - fill;
+				batch = nullptr;
+			} else if (batch == nullptr && finishing) {
+				// Rows were being dropped when the recording ended, so an empty batch closes the file
+				pros::c::sem_wait(recorder->emptyBatches, TIMEOUT_MAX);
+				Batch& closing = recorder->batches[fill];
+				closing.count = 0;
+				closing.first = false;
+				closing.last = true;
+				pros::c::sem_post(recorder->filledBatches);
+				fill = 1 - fill;
+			}
+			if (batch == nullptr && !finishing && pros::c::sem_wait(recorder->emptyBatches, 0)) {
+				batch = &recorder->batches[fill];
+				batch->count = 0;
+				batch->slot = slot;
+				batch->tickMs = tickMs;
+				batch->first = false;
+				batch->last = false;
+			}
+			if (!finishing) {
+				pros::c::task_delay_until(&wakeTime, tickMs);
+			}
+		}
+	}
+}
+
+void TelemetryRecorder::writeTask(void* param) {
+	TelemetryRecorder* recorder = static_cast<TelemetryRecorder*>(param);
+	int index = 0;
+
+	while (true) {
+		if (!pros::c::sem_wait(recorder->filledBatches, TIMEOUT_MAX)) {
+			continue;
+		}
+		const Batch& batch = recorder->batches[index];
+		index = 1 - index;
+
+		if (batch.first) {
+			std::string filePath = replayFilePath(batch.slot, "tlm");
+			recorder->file = std::fopen(filePath.c_str(), "wb");
+			TelemetryHeader header = {TELEMETRY_MAGIC, TELEMETRY_VERSION, batch.tickMs, uint16_t(recorder->columns.size()), BATCH_SIZE};
+			bool written = recorder->file != nullptr && std::fwrite(&header, sizeof(header), 1, recorder->file) == 1;
+			for (size_t i = 0; written && i < recorder->columns.size(); i++) {
+				TelemetryColumn column = {};
+				std::strncpy(column.name, recorder->columns[i].c_str(), sizeof(column.name));
+				written = std::fwrite(&column, sizeof(column), 1, recorder->file) == 1;
+			}
+			if (!written) {
+				recorder->writeFailed = true;
+			}
+		}
+		if (recorder->file != nullptr && !recorder->writeFailed && batch.count > 0 && !recorder->write(batch)) {
+			recorder->writeFailed = true;
+		}
+
+		bool last = batch.last;		// Read before the batch is handed back
+		pros::c::sem_post(recorder->emptyBatches);
+		if (last) {
+			if (recorder->file != nullptr) {
+				std::fclose(recorder->file);
+				recorder->file = nullptr;
+			}
+			recorder->recording = false;
+		}
+	}
+}
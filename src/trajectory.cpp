@@ -0,0 +1,39 @@
+#include "trajectory.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+TrajectoryFollower::TrajectoryFollower(TrajectoryGains gains) : gains(gains) {}
+
+void TrajectoryFollower::reset(double startPosition) {
+	this->startPosition = startPosition;
+	integral = 0;
+	lastError = 0;
+	largestError = 0;
+}
+
+int TrajectoryFollower::update(int16_t command, int32_t recordedPosition, int16_t recordedVelocity,
+                               double actualPosition, double actualVelocity, float dtSeconds) {
+	float positionError = float(recordedPosition / 10.0 - (actualPosition - startPosition));
+	float velocityError = float(recordedVelocity - actualVelocity);
+
+	// Clamped so a long stall can't wind the integral up past what it may add
+	if (gains.kI > 0) {
+		float integralLimit = gains.integralLimit / gains.kI;
+		integral = std::clamp(integral + positionError * dtSeconds, -integralLimit, integralLimit);
+	}
+
+	lastError = positionError;
+	largestError = std::max(largestError, std::fabs(positionError));
+
+	float output = command + gains.kP * positionError + gains.kI * integral + gains.kD * velocityError;
+	return int(std::lround(std::clamp(output, -127.0f, 127.0f)));
+}
+
+float TrajectoryFollower::error() const {
+	return lastError;
+}
+
+float TrajectoryFollower::maxError() const {
+	return largestError;
+}
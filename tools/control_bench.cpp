@@ -0,0 +1,391 @@
+// Runs the robot's control code on a PC against the mock HAL, checks it, then
+// benchmarks it.
+//
+//   control_bench [ticks to benchmark]
+//
+// The checks first feed InputLayer scripted frames and compare its events with
+// the ones expected: releases, holds, double taps and chords. Then they drive
+// the real InputLayer, Bindings, DriveControl, ReplayControl and actuator
+// layer through a scripted match on the mock controller and clock: drive
+// around, record, stop, then replay. The replay has to send the motors
+// exactly what was recorded, tick for tick, and idle ticks have to be left
+// off the bus. Exits with 1 if anything is wrong.
+//
+// The benchmark then times the control task's work for one tick, from
+// reading the controller to writing the motors.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "actuators.hpp"
+#include "bindings.hpp"
+#include "drive_control.hpp"
+#include "hal.hpp"
+#include "input.hpp"
+#include "replay_control.hpp"
+
+#ifndef HAL_MOCK
+#error "Build with -DHAL_MOCK, see the Makefile"
+#endif
+
+namespace {
+
+constexpr uint32_t TICK_MS = 20;
+
+/**
+ * Keeps replays in memory, one recording at a time.
+ */
+struct MemoryIo {
+	bool recorderBusy() {
+		return false;
+	}
+
+	bool beginRecording(int, uint16_t tickMs, const ReplayDriverInfo&) {
+		this->tickMs = tickMs;
+		recording.clear();
+		return true;
+	}
+
+	void record(const Iteration& iteration, uint64_t) {
+		recording.push_back(iteration);
+	}
+
+	void finishRecording() {
+		saved = recording;
+	}
+
+	bool openReplay(int) {
+		return !saved.empty();
+	}
+
+	bool replayHasTrajectory() {
+		return false;
+	}
+
+	bool replayAt(uint64_t timeUs, Iteration& iteration) {
+		size_t index = timeUs / (tickMs * 1000);
+		if (index >= saved.size()) {
+			return false;
+		}
+		iteration = saved[index];
+		return true;
+	}
+
+	bool replayFailed() {
+		return false;
+	}
+
+	void closeReplay() {}
+
+	void message(const char* text) {
+		std::printf("  %s\n", text);
+	}
+
+	void trackingError(const TrajectoryFollower&, const TrajectoryFollower&) {}
+
+	uint16_t tickMs = TICK_MS;
+	std::vector<Iteration> recording;
+	std::vector<Iteration> saved;
+};
+
+/**
+ * The control task's side of opcontrol(), minus the channels and the
+ * scheduler, with the replay state machine called inline.
+ */
+struct Robot {
+	Robot() : bindings(input), replay(io) {
+		input.readOnly(bindings.BUTTONS, drive.AXES);
+	}
+
+	// Runs one tick and returns what went to the drive
+	DriveCommand tick() {
+		input.update();
+		uint32_t actions = bindings.evaluate(input);
+		if (actions & actionBit(ACTION_RECORD)) {
+			replay.handle(EVENT_RECORD);
+		}
+		if (actions & actionBit(ACTION_REPLAY)) {
+			replay.handle(EVENT_REPLAY);
+		}
+		DriveCommand command = drive.update(input, actions);
+		bool haveDrive = replay.state().status != STATUS_DRIVING;
+		replay.update({hal::micros(), {int16_t(command.left), int16_t(command.right), int16_t(command.intake), command.goalClamp, 0, 0, 0, 0}, haveDrive});
+		const ReplayOutput& output = replay.output();
+		if (output.active) {
+			command = {output.left, output.right, output.intake, output.goalClamp};
+		}
+		leftOutput.move(command.left);
+		rightOutput.move(command.right);
+		intakeOutput.move(command.intake * 127);
+		goalClampOutput.set(command.goalClamp);
+		return command;
+	}
+
+	InputLayer input;
+	Bindings<DRIVER_BINDINGS> bindings;
+	DriveControl drive;
+	MemoryIo io;
+	ReplayControl<MemoryIo> replay;
+	hal::MotorGroup leftMotors{-20, -1};
+	hal::MotorGroup rightMotors{19, 2};
+	hal::MotorGroup intakeMotor{-18};
+	hal::DigitalOut goalClamp{'A'};
+	ActuatorStats stats = {};
+	MotorOutput leftOutput{leftMotors, stats};
+	MotorOutput rightOutput{rightMotors, stats};
+	MotorOutput intakeOutput{intakeMotor, stats};
+	DigitalOutput goalClampOutput{goalClamp, stats};
+};
+
+constexpr uint16_t A = buttonMask(BUTTON_A);
+constexpr uint16_t B = buttonMask(BUTTON_B);
+constexpr uint16_t Y = buttonMask(BUTTON_Y);
+
+/**
+ * One frame fed to InputLayer and the events it should give back.
+ */
+struct InputStep {
+	uint32_t timeMs;
+	uint16_t buttons;		// Down in this frame
+	uint16_t pressed;
+	uint16_t released;
+	uint16_t held;
+	uint16_t doubleTapped;
+	bool chord;				// The script's chord fires
+};
+
+// Plays a script through a fresh InputLayer with one chord registered
+template <size_t N>
+bool inputScript(const char* name, InputTiming timing, uint16_t chordButtons, const InputStep (&steps)[N]) {
+	InputLayer input({}, timing);
+	int chord = input.addChord(chordButtons);
+	bool ok = true;
+	for (const InputStep& step : steps) {
+		input.update({step.timeMs, step.buttons, {}});
+		// The event list has to agree with the masks
+		uint16_t events[INPUT_CHORD + 1] = {};
+		for (int i = 0; i < input.eventCount(); i++) {
+			events[input.events()[i].type] |= input.events()[i].buttons;
+		}
+		uint16_t chordEvents = input.chord(chord) ? chordButtons : 0;
+		if (input.pressedButtons() != step.pressed || input.releasedButtons() != step.released ||
+		    input.heldButtons() != step.held || input.doubleTappedButtons() != step.doubleTapped ||
+		    input.chord(chord) != step.chord) {
+			std::printf("  %s at %ums: pressed %03x released %03x held %03x double %03x chord %d, expected %03x %03x %03x %03x %d\n", name,
+			            unsigned(step.timeMs), input.pressedButtons(), input.releasedButtons(), input.heldButtons(),
+			            input.doubleTappedButtons(), input.chord(chord), step.pressed, step.released, step.held, step.doubleTapped,
+			            step.chord);
+			ok = false;
+		} else if (events[INPUT_PRESS] != step.pressed || events[INPUT_RELEASE] != step.released ||
+		           events[INPUT_HOLD] != step.held || events[INPUT_DOUBLE_TAP] != step.doubleTapped ||
+		           events[INPUT_CHORD] != chordEvents) {
+			std::printf("  %s at %ums: events do not match the masks\n", name, unsigned(step.timeMs));
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+bool checkInput() {
+	std::printf("Input events\n");
+	bool ok = true;
+
+	// Hold fires once per press, at holdMs, and again on the next press
+	const InputStep hold[] = {
+		{0, A, A, 0, 0, 0, false},
+		{20, A, 0, 0, 0, 0, false},
+		{499, A, 0, 0, 0, 0, false},
+		{500, A, 0, 0, A, 0, false},
+		{520, A, 0, 0, 0, 0, false},
+		{600, 0, 0, A, 0, 0, false},
+		{1000, A, A, 0, 0, 0, false},
+		{1400, 0, 0, A, 0, 0, false},		// Let go before the hold time
+		{1500, A, A, 0, 0, 0, false},
+		{2000, A, 0, 0, A, 0, false},
+		{2020, 0, 0, A, 0, 0, false},
+	};
+	ok &= inputScript("hold", {}, Y | B, hold);
+
+	// A third tap starts a new pair, so taps two and four are double taps
+	const InputStep doubleTap[] = {
+		{0, B, B, 0, 0, 0, false},
+		{40, 0, 0, B, 0, 0, false},
+		{100, B, B, 0, 0, B, false},
+		{140, 0, 0, B, 0, 0, false},
+		{200, B, B, 0, 0, 0, false},
+		{240, 0, 0, B, 0, 0, false},
+		{500, B, B, 0, 0, B, false},		// doubleTapMs after the third, still in time
+		{540, 0, 0, B, 0, 0, false},
+		{900, B, B, 0, 0, 0, false},
+		{940, 0, 0, B, 0, 0, false},
+		{1241, B, B, 0, 0, 0, false},		// One millisecond too late
+		{1260, A | B, A, 0, 0, 0, false},	// Each button pairs on its own
+		{1300, A, 0, B, 0, 0, false},
+		{1320, 0, 0, A, 0, 0, false},
+		{1340, A, A, 0, 0, A, false},
+		{1360, 0, 0, A, 0, 0, false},
+	};
+	ok &= inputScript("double tap", {}, Y | B, doubleTap);
+
+	// A chord fires again only after every one of its buttons is up
+	InputTiming noTaps = {10000, 0, 0};
+	const InputStep chord[] = {
+		{0, Y, Y, 0, 0, 0, false},
+		{100, Y | B, B, 0, 0, 0, true},
+		{120, Y | B, 0, 0, 0, 0, false},
+		{200, Y, 0, B, 0, 0, false},
+		{220, Y | B, B, 0, 0, 0, false},	// Y never came up
+		{300, B, 0, Y, 0, 0, false},
+		{320, Y | B, Y, 0, 0, 0, false},	// Nor did B
+		{400, 0, 0, Y | B, 0, 0, false},
+		{420, Y | B, Y | B, 0, 0, 0, true},
+		{440, Y | B | A, A, 0, 0, 0, false},	// Other buttons don't matter
+		{460, A, 0, Y | B, 0, 0, false},
+		{480, A | Y | B, Y | B, 0, 0, 0, true},
+	};
+	ok &= inputScript("chord", noTaps, Y | B, chord);
+
+	// With chordWindowMs, the last button has to follow the first in time
+	InputTiming window = {10000, 0, 100};
+	const InputStep chordWindow[] = {
+		{0, Y, Y, 0, 0, 0, false},
+		{101, Y | B, B, 0, 0, 0, false},	// Too slow
+		{200, Y | B, 0, 0, 0, 0, false},	// And stays spent until both are up
+		{220, Y, 0, B, 0, 0, false},
+		{240, Y | B, B, 0, 0, 0, false},
+		{300, 0, 0, Y | B, 0, 0, false},
+		{400, B, B, 0, 0, 0, false},
+		{500, Y | B, Y, 0, 0, 0, true},		// Exactly chordWindowMs
+		{520, 0, 0, Y | B, 0, 0, false},
+		{600, Y | B, Y | B, 0, 0, 0, true},
+	};
+	ok &= inputScript("chord window", window, Y | B, chordWindow);
+
+	if (ok) {
+		std::printf("  as expected\n");
+	}
+	return ok;
+}
+
+// What the driver does on a given tick of the scripted match
+void driver(int tick) {
+	hal::mock::controllerButtons = 0;
+	for (int8_t& axis : hal::mock::controllerAxes) {
+		axis = 0;
+	}
+	auto press = [](Button button) { hal::mock::controllerButtons |= buttonMask(button); };
+	if (tick == 10 || tick == 400) {
+		press(BUTTON_X);		// Record, then stop
+	}
+	if (tick == 450) {
+		press(BUTTON_A);		// Replay
+	}
+	if (tick < 420) {
+		// Sweeps the sticks around so every channel changes
+		hal::mock::controllerAxes[AXIS_LEFT_Y] = int8_t((tick * 7) % 255 - 127);
+		hal::mock::controllerAxes[AXIS_RIGHT_X] = int8_t((tick * 3) % 101 - 50);
+		if ((tick / 25) % 2) {
+			press(BUTTON_L1);
+		}
+		if ((tick / 40) % 2) {
+			press(BUTTON_R1);
+		}
+	}
+}
+
+bool check() {
+	hal::mock::reset();
+	Robot robot;
+	std::vector<DriveCommand> sent;
+	int recordStart = -1;
+	int replayStart = -1;
+	for (int tick = 0; tick < 1000; tick++) {
+		driver(tick);
+		Status before = robot.replay.state().status;
+		DriveCommand command = robot.tick();
+		Status after = robot.replay.state().status;
+		if (after == STATUS_RECORDING && before != STATUS_RECORDING) {
+			recordStart = tick;
+		}
+		if (after == STATUS_REPLAYING && before != STATUS_REPLAYING) {
+			replayStart = tick;
+		}
+		sent.push_back(command);
+		hal::mock::advance(TICK_MS * 1000);
+	}
+
+	bool ok = true;
+	size_t recorded = robot.io.saved.size();
+	std::printf("Recorded %zu ticks from tick %d, replayed from tick %d\n", recorded, recordStart, replayStart);
+	if (recordStart < 0 || replayStart < 0 || recorded == 0) {
+		std::printf("  never recorded and replayed\n");
+		return false;
+	}
+	if (recordStart != 10 + int(ReplayControl<MemoryIo>::COUNTDOWN_MS / TICK_MS)) {
+		std::printf("  recording started on the wrong tick\n");
+		ok = false;
+	}
+	for (size_t i = 0; i < recorded && ok; i++) {
+		// The tick recording starts on only opens the recorder, the next is the first recorded
+		const DriveCommand& driven = sent[recordStart + 1 + i];
+		const DriveCommand& replayed = sent[replayStart + i];
+		if (driven.left != replayed.left || driven.right != replayed.right || driven.intake != replayed.intake || driven.goalClamp != replayed.goalClamp) {
+			std::printf("  tick %zu of the replay differs: %d %d %d %d, recorded %d %d %d %d\n", i, replayed.left, replayed.right,
+			            replayed.intake, replayed.goalClamp, driven.left, driven.right, driven.intake, driven.goalClamp);
+			ok = false;
+		}
+	}
+	if (robot.replay.state().status != STATUS_DRIVING) {
+		std::printf("  replay never finished\n");
+		ok = false;
+	}
+
+	// Nothing changes for the last ticks, so only keep-alives may go out
+	uint32_t writes = hal::mock::motors[20].writes;
+	uint32_t idleTicks = 1000 - (replayStart + recorded);
+	std::printf("Actuators: %u writes sent, %u saved. Port 20 written %u times in 1000 ticks\n", unsigned(robot.stats.sent),
+	            unsigned(robot.stats.saved), unsigned(writes));
+	if (robot.stats.saved < idleTicks) {
+		std::printf("  idle ticks were not left off the bus\n");
+		ok = false;
+	}
+	if (hal::mock::motors[20].power != 0 || hal::mock::motors[1].power != 0) {
+		std::printf("  drive did not stop after the replay\n");
+		ok = false;
+	}
+	return ok;
+}
+
+void benchmark(long ticks) {
+	hal::mock::reset();
+	Robot robot;
+	auto start = std::chrono::steady_clock::now();
+	long checksum = 0;
+	for (long tick = 0; tick < ticks; tick++) {
+		hal::mock::controllerAxes[AXIS_LEFT_Y] = int8_t((tick * 7) % 255 - 127);
+		hal::mock::controllerAxes[AXIS_RIGHT_X] = int8_t((tick * 3) % 101 - 50);
+		DriveCommand command = robot.tick();
+		checksum += command.left - command.right;
+		hal::mock::advance(TICK_MS * 1000);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::printf("Control tick: %.0f ns, %.0f ticks a second (checksum %ld)\n", seconds * 1e9 / ticks, ticks / seconds, checksum);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+	long ticks = argc > 1 ? std::atol(argv[1]) : 1000000;
+	if (ticks <= 0) {
+		std::fprintf(stderr, "usage: control_bench [ticks to benchmark]\n");
+		return 2;
+	}
+
+	bool ok = checkInput();
+	ok &= check();
+	benchmark(ticks);
+	std::printf(ok ? "Control check passed\n" : "Control check FAILED\n");
+	return ok ? 0 : 1;
+}
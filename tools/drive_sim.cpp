@@ -0,0 +1,690 @@
+// Host simulator of the robot's drivetrain, intake and goal clamp.
+//
+//   drive_sim [options] FILE...
+//
+// replayN.bin files are played the way autonomous() plays them, closed loop
+// when they hold a trajectory. Any other file is a controller trace, driven
+// through the same InputLayer, Bindings and DriveControl as opcontrol(). The
+// trace is text, one line per change, held until the next line:
+//
+//   # time_ms  left_x  left_y  right_x  right_y  buttons
+//   0          0       0       0        0        0
+//   500        0       127     0        0        0x1
+//
+// with buttons a mask of buttonMask() bits from input.hpp, so 0x1 is L1.
+//
+// The control code runs against the mock HAL, and the model here stands in
+// for the hardware behind it: every motor command is read back out of
+// hal::mock, and the simulated encoders are written back in. Each side of the
+// drive is two V5 motors on a linear torque-speed curve, geared to wheels
+// with their own inertia that grip the field through a friction model, so
+// they slip when pushed too hard. The body has mass and turning inertia.
+// Everything steps on a fixed 0.5ms grid with no randomness, so a run gives
+// the same result every time, far faster than real time.
+//
+// For replays with a trajectory it reports how far the simulated robot ends
+// up from where the recording's encoders say the real one went.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "actuators.hpp"
+#include "bindings.hpp"
+#include "drive_control.hpp"
+#include "filters.hpp"
+#include "hal.hpp"
+#include "input.hpp"
+#include "replay_format.hpp"
+#include "trajectory.hpp"
+
+#ifndef HAL_MOCK
+#error "Build with -DHAL_MOCK, see the Makefile"
+#endif
+
+namespace {
+
+constexpr double INCH = 0.0254;
+constexpr double GRAVITY = 9.81;
+constexpr double STEP_SECONDS = 0.0005;
+constexpr double SLIP_SPEED = 0.1;			// m/s of slip where the tyres give most of their grip
+constexpr double SLIPPING = 2 * INCH;		// m/s of slip counted as slipping in the report
+
+struct Options {
+	int deadzone = 10;				// Same as driveDeadzone in main.cpp
+	double wheelDiameter = 3.25;	// Inches
+	double trackWidth = 12.0;		// Inches between the left and right wheels
+	double gearRatio = 1.0;			// Wheel turns per motor turn
+	double motorRpm = 600;			// Cartridge free speed at 12V
+	double stallTorque = 0.35;		// Nm at the cartridge output, the 600 RPM cartridge's
+	double battery = 12.8;			// Volts, the motors never get more than 12
+	double mass = 7.0;				// kg
+	double friction = 1.0;			// Tyre to tile
+	bool openLoop = false;			// Play replays open loop even with a trajectory
+	bool path = false;				// Print the simulated path, not just where it ends
+};
+
+/**
+ * The robot's ports, as in main.cpp.
+ */
+constexpr int8_t LEFT_PORTS[] = {-20, -1};
+constexpr int8_t RIGHT_PORTS[] = {19, 2};
+constexpr int8_t INTAKE_PORT = -18;
+constexpr int8_t RAMP_PORT = -17;
+constexpr int CLAMP_PORT = 0;		// 'A'
+
+struct Pose {
+	double x = 0;		// Inches
+	double y = 0;
+	double heading = 0;	// Radians, anticlockwise
+};
+
+double headingDegrees(double heading) {
+	return std::remainder(heading, 2 * M_PI) * 180 / M_PI;
+}
+
+/**
+ * Torque a V5 motor puts out at its cartridge output, from the voltage it is
+ * commanded and how fast it is already turning. Linear from stall to free
+ * speed, and capped at stall torque the way its current limit caps it.
+ */
+double motorTorque(const hal::mock::Motor& motor, double rpm, const Options& options) {
+	if (motor.braking) {
+		return 0;		// brake() coasts unless the brake mode is changed, and main.cpp never does
+	}
+	double volts = std::clamp(motor.power, -127, 127) / 127.0 * std::min(12.0, options.battery);
+	double fraction = volts / 12.0 - rpm / options.motorRpm;
+	return options.stallTorque * std::clamp(fraction, -1.0, 1.0);
+}
+
+/**
+ * Wheel speed in motor RPM for a port, which reports it reversed if the port
+ * is. hal::mock keeps motors as seen from their shafts.
+ */
+double shaftRpm(int8_t port, double wheelOmega, const Options& options) {
+	return (port < 0 ? -1 : 1) * wheelOmega / options.gearRatio * 60 / (2 * M_PI);
+}
+
+/**
+ * One side of the drive: its motors, the gearing and the wheels as one
+ * spinning mass.
+ */
+struct DriveSide {
+	const int8_t* ports;
+	double omega = 0;		// Wheel rad/s
+	double angle = 0;		// Wheel radians
+
+	static constexpr double INERTIA = 0.003;	// kg m^2 at the wheels, gears and motors included
+	static constexpr double DRAG = 0.002;		// Nm per rad/s of friction in the gearing
+
+	// Torque at the wheels from this side's motors
+	double torque(const Options& options) const {
+		double total = 0;
+		for (int i = 0; i < 2; i++) {
+			double rpm = shaftRpm(ports[i], omega, options);
+			total += (ports[i] < 0 ? -1 : 1) * motorTorque(hal::mock::motors[std::abs(ports[i])], rpm, options);
+		}
+		return total / options.gearRatio - DRAG * omega;
+	}
+
+	// Writes where the encoders are into hal::mock
+	void publish(const Options& options) const {
+		for (int i = 0; i < 2; i++) {
+			hal::mock::Motor& motor = hal::mock::motors[std::abs(ports[i])];
+			double sign = ports[i] < 0 ? -1 : 1;
+			motor.position = sign * angle / options.gearRatio * 180 / M_PI;
+			motor.velocity = shaftRpm(ports[i], omega, options);
+		}
+	}
+};
+
+/**
+ * An intake or ramp roller on one motor.
+ */
+struct Roller {
+	int8_t port;
+	double omega = 0;		// rad/s at the motor
+	double angle = 0;
+
+	static constexpr double INERTIA = 0.0004;
+	static constexpr double LOAD = 0.03;		// Nm of friction, rings dragging included
+	static constexpr double DRAG = 0.0005;
+
+	// Where the roller settles for a power, the motor curve against the load
+	static double topRpm(int power, const Options& options) {
+		double fraction = std::abs(power) / 127.0 * std::min(12.0, options.battery) / 12.0;
+		return std::max(0.0, (options.stallTorque * fraction - LOAD) / (options.stallTorque / options.motorRpm + DRAG * 2 * M_PI / 60));
+	}
+
+	void step(double dt, const Options& options) {
+		double rpm = (port < 0 ? -1 : 1) * omega * 60 / (2 * M_PI);		// Direct drive, no gearing
+		double torque = (port < 0 ? -1 : 1) * motorTorque(hal::mock::motors[std::abs(port)], rpm, options);
+		torque -= DRAG * omega + (std::abs(omega) > 0.01 ? std::copysign(LOAD, omega) : std::clamp(torque, -LOAD, LOAD));
+		omega += torque / INERTIA * dt;
+		angle += omega * dt;
+		hal::mock::Motor& motor = hal::mock::motors[std::abs(port)];
+		motor.position = (port < 0 ? -1 : 1) * angle * 180 / M_PI;
+		motor.velocity = rpm;
+	}
+};
+
+struct SimStats {
+	double travelled = 0;		// Inches
+	double maxSlip = 0;			// Inches per second
+	uint64_t slippingSteps = 0;
+	uint64_t steps = 0;
+	double intakeSeconds = 0;	// Intake at 90% of its top speed under load or more
+	double spinUp = 0;			// Longest the intake took to get there, seconds
+	int clampCloses = 0;
+};
+
+/**
+ * The whole robot on the field.
+ */
+class RobotModel {
+	public:
+	explicit RobotModel(const Options& options)
+	    : options(options), radius(options.wheelDiameter * INCH / 2), track(options.trackWidth * INCH) {
+		left.ports = LEFT_PORTS;
+		right.ports = RIGHT_PORTS;
+		// A box about the size of the robot for its turning inertia
+		yawInertia = options.mass * (2 * 0.38 * 0.38) / 12;
+		publish();
+	}
+
+	/**
+	 * Runs the physics for a control tick, reading the latest commands out
+	 * of hal::mock and moving its clock along with it.
+	 */
+	void run(double seconds) {
+		int steps = int(std::lround(seconds / STEP_SECONDS));
+		for (int i = 0; i < steps; i++) {
+			step(STEP_SECONDS);
+			hal::mock::advance(uint64_t(STEP_SECONDS * 1e6));
+		}
+		publish();
+	}
+
+	const Pose& pose() const {
+		return current;
+	}
+
+	const SimStats& stats() const {
+		return simStats;
+	}
+
+	private:
+	void step(double dt) {
+		// Grip from each side's tyres, from how fast they slide over the tiles
+		double normal = options.mass * GRAVITY / 2;
+		double leftGround = speed - spin * track / 2;
+		double rightGround = speed + spin * track / 2;
+		double leftSlip = left.omega * radius - leftGround;
+		double rightSlip = right.omega * radius - rightGround;
+		double leftForce = options.friction * normal * std::tanh(leftSlip / SLIP_SPEED);
+		double rightForce = options.friction * normal * std::tanh(rightSlip / SLIP_SPEED);
+
+		left.omega += (left.torque(options) - leftForce * radius) / DriveSide::INERTIA * dt;
+		right.omega += (right.torque(options) - rightForce * radius) / DriveSide::INERTIA * dt;
+		left.angle += left.omega * dt;
+		right.angle += right.omega * dt;
+
+		// Rolling resistance, and the wheels scrubbing sideways in a turn
+		double rolling = 0.5 * speed;
+		double scrub = 0.3 * std::tanh(spin / 0.5);
+		speed += (leftForce + rightForce - rolling) / options.mass * dt;
+		spin += ((rightForce - leftForce) * track / 2 - scrub) / yawInertia * dt;
+		double moved = speed * dt / INCH;
+		current.x += moved * std::cos(current.heading);
+		current.y += moved * std::sin(current.heading);
+		current.heading += spin * dt;
+
+		intake.step(dt, options);
+		ramp.step(dt, options);
+		stepClamp(dt);
+
+		double slip = std::max(std::abs(leftSlip), std::abs(rightSlip));
+		simStats.travelled += std::abs(moved);
+		simStats.maxSlip = std::max(simStats.maxSlip, slip / INCH);
+		simStats.slippingSteps += slip > SLIPPING;
+		simStats.steps++;
+		trackIntake(dt);
+	}
+
+	// The piston takes CLAMP_SECONDS to travel, a close counts once it is all the way in
+	void stepClamp(double dt) {
+		constexpr double CLAMP_SECONDS = 0.15;
+		double target = hal::mock::digitalOuts[CLAMP_PORT] ? 1 : 0;
+		double before = clamp;
+		clamp += std::clamp(target - clamp, -dt / CLAMP_SECONDS, dt / CLAMP_SECONDS);
+		if (clamp >= 1 && before < 1) {
+			simStats.clampCloses++;
+		}
+	}
+
+	void trackIntake(double dt) {
+		const hal::mock::Motor& motor = hal::mock::motors[std::abs(INTAKE_PORT)];
+		double rpm = std::abs(intake.omega) * 60 / (2 * M_PI);
+		if (motor.power == 0) {
+			spinningUp = -1;
+		} else if (rpm >= 0.9 * Roller::topRpm(motor.power, options)) {
+			simStats.intakeSeconds += dt;
+			if (spinningUp >= 0) {
+				simStats.spinUp = std::max(simStats.spinUp, spinningUp);
+				spinningUp = -1;
+			}
+		} else if (spinningUp < 0) {
+			spinningUp = 0;
+		} else {
+			spinningUp += dt;
+		}
+	}
+
+	void publish() {
+		left.publish(options);
+		right.publish(options);
+	}
+
+	Options options;
+	double radius;		// Metres
+	double track;
+	double yawInertia;
+	DriveSide left;
+	DriveSide right;
+	Roller intake{INTAKE_PORT};
+	Roller ramp{RAMP_PORT};
+	double clamp = 0;		// 0 open, 1 closed
+	double speed = 0;		// m/s forwards
+	double spin = 0;		// rad/s anticlockwise
+	Pose current;
+	SimStats simStats;
+	double spinningUp = -1;		// Seconds the intake has been getting up to speed, -1 if it isn't
+};
+
+/**
+ * The motors and piston as main.cpp writes them.
+ */
+struct Actuators {
+	hal::MotorGroup left{LEFT_PORTS[0], LEFT_PORTS[1]};
+	hal::MotorGroup right{RIGHT_PORTS[0], RIGHT_PORTS[1]};
+	hal::MotorGroup intake{INTAKE_PORT};
+	hal::MotorGroup ramp{RAMP_PORT};
+	hal::DigitalOut goalClamp{'A'};
+	ActuatorStats stats = {};
+	MotorOutput leftOutput{left, stats};
+	MotorOutput rightOutput{right, stats};
+	MotorOutput intakeOutput{intake, stats};
+	MotorOutput rampOutput{ramp, stats};
+	DigitalOutput goalClampOutput{goalClamp, stats};
+
+	void drive(int leftPower, int rightPower, int deadzone) {
+		if (leftPower < -deadzone || leftPower > deadzone) {		// Brakes inside the deadzone like main.cpp
+			leftOutput.move(leftPower);
+		} else {
+			leftOutput.brake();
+		}
+		if (rightPower < -deadzone || rightPower > deadzone) {
+			rightOutput.move(rightPower);
+		} else {
+			rightOutput.brake();
+		}
+	}
+
+	void stop() {
+		leftOutput.move(0);
+		rightOutput.move(0);
+		intakeOutput.move(0);
+		rampOutput.move(0);
+		goalClampOutput.set(false);
+	}
+};
+
+void appendf(std::string& out, const char* format, ...) {
+	char line[256];
+	va_list args;
+	va_start(args, format);
+	std::vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	out += line;
+}
+
+bool readFile(const char* path, std::vector<uint8_t>& data) {
+	FILE* file = std::fopen(path, "rb");
+	if (file == nullptr) {
+		return false;
+	}
+	uint8_t buffer[4096];
+	size_t length;
+	while ((length = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + length);
+	}
+	std::fclose(file);
+	return true;
+}
+
+bool isReplay(const char* path) {
+	size_t length = std::strlen(path);
+	return length >= 4 && std::strcmp(path + length - 4, ".bin") == 0;
+}
+
+/**
+ * One run of the simulator, however it was driven.
+ */
+struct Run {
+	std::vector<Pose> poses;	// One per control tick
+	double seconds = 0;			// Simulated
+	double wallSeconds = 0;
+	SimStats stats;
+	ActuatorStats actuators = {};
+	std::string notes;			// Anything specific to how it was driven
+};
+
+void summarize(std::string& out, const Run& run, const Options& options, uint16_t tickMs) {
+	const Pose& end = run.poses.empty() ? Pose{} : run.poses.back();
+	appendf(out, "  simulated %.2fs in %.1fms, %.0fx real time\n", run.seconds, run.wallSeconds * 1000,
+	        run.seconds / std::max(run.wallSeconds, 1e-9));
+	appendf(out, "  path: ends at (%.1f, %.1f) in, heading %.0f deg, %.1f in travelled\n", end.x, end.y,
+	        headingDegrees(end.heading), run.stats.travelled);
+	appendf(out, "  slip: up to %.1f in/s, slipping %.1f%% of the time\n", run.stats.maxSlip,
+	        100.0 * run.stats.slippingSteps / std::max<uint64_t>(1, run.stats.steps));
+	appendf(out, "  intake: at speed for %.2fs, %.0fms at most to get there; clamp closed %d times\n",
+	        run.stats.intakeSeconds, run.stats.spinUp * 1000, run.stats.clampCloses);
+	appendf(out, "  actuator writes: %u sent, %u saved\n", unsigned(run.actuators.sent), unsigned(run.actuators.saved));
+	out += run.notes;
+	if (options.path) {
+		size_t step = std::max<size_t>(1, 1000 / std::max<uint16_t>(1, tickMs));
+		for (size_t i = 0; i < run.poses.size(); i += step) {
+			const Pose& pose = run.poses[i];
+			appendf(out, "    %6.2fs %8.1f %8.1f %6.0f\n", i * tickMs / 1000.0, pose.x, pose.y, headingDegrees(pose.heading));
+		}
+	}
+}
+
+/**
+ * Plays a replay file the way autonomous() does: looked up by time on the
+ * simulated clock through ReplayPlayhead, the same code as ReplayReader::at(),
+ * with the intake through an IntakeFilter. The simulated loop never runs
+ * late, so it lands on the recorded ticks where the robot's may blend two.
+ */
+bool simulateReplay(const char* path, const Options& options, std::string& out) {
+	std::vector<uint8_t> data;
+	if (!readFile(path, data)) {
+		appendf(out, "  error: can't open: %s\n", std::strerror(errno));
+		return false;
+	}
+	ReplayInfo info;
+	bool recovered;
+	std::vector<uint8_t> payload;
+	if (!replayParse(data.data(), data.size(), payload, info, recovered)) {
+		appendf(out, "  error: not a valid replay\n");
+		return false;
+	}
+	uint16_t tickMs = info.tickMs > 0 ? info.tickMs : 20;		// As ReplayReader::tickMs()
+	bool trajectory = info.channels == 8;
+	bool closedLoop = trajectory && !options.openLoop;
+	appendf(out, "  %u ticks of %ums, %s\n", unsigned(info.count), unsigned(tickMs),
+	        closedLoop ? "closed loop" : trajectory ? "open loop, trajectory ignored" : "open loop, no trajectory");
+
+	ReplayDecoder decoder;
+	decoder.reset(info);
+	const uint8_t* position = payload.data();
+	auto next = [&](Iteration& iteration) {
+		return decoder.next(iteration, position, payload.data() + payload.size()) == DECODE_OK;
+	};
+	ReplayPlayhead playhead;
+
+	hal::mock::reset();
+	RobotModel robot(options);
+	Actuators actuators;
+	TrajectoryFollower leftFollower;
+	TrajectoryFollower rightFollower;
+	leftFollower.reset(actuators.left.position());
+	rightFollower.reset(actuators.right.position());
+	IntakeFilter intakeFilter;
+
+	Run run;
+	double tickSeconds = tickMs / 1000.0;
+	double maxError = 0;
+	Pose recorded;			// Dead reckoned from the recording's encoders
+	bool haveRecorded = false;
+	Iteration previous = {};
+	double inchesPerDegree = M_PI * options.wheelDiameter * options.gearRatio / 360.0;
+	uint32_t ticks = 0;
+	uint64_t startTime = hal::micros();
+	uint64_t elapsed = 0;
+	uint64_t lastElapsed = 0;
+	Iteration step;
+	auto start = std::chrono::steady_clock::now();
+	while (playhead.at(elapsed, tickMs, step, next)) {
+		int leftPower = step.left;
+		int rightPower = step.right;
+		if (closedLoop) {
+			float dt = (elapsed - lastElapsed) / 1e6f;
+			leftPower = leftFollower.update(step.left, step.leftPosition, step.leftVelocity, actuators.left.position(), actuators.left.velocity(), dt);
+			rightPower = rightFollower.update(step.right, step.rightPosition, step.rightVelocity, actuators.right.position(), actuators.right.velocity(), dt);
+		}
+		actuators.drive(leftPower, rightPower, options.deadzone);
+		int intakePower = intakeFilter.apply(step.intake * 127);
+		actuators.intakeOutput.move(intakePower);
+		actuators.rampOutput.move(intakePower);
+		actuators.goalClampOutput.set(step.goalClamp);
+		robot.run(tickSeconds);
+		run.poses.push_back(robot.pose());
+		ticks++;
+
+		if (trajectory) {
+			maxError = std::max({maxError, std::abs(actuators.left.position() - step.leftPosition / 10.0),
+			                     std::abs(actuators.right.position() - step.rightPosition / 10.0)});
+			if (!haveRecorded) {
+				previous = step;
+				haveRecorded = true;
+			}
+			double leftMoved = (step.leftPosition - previous.leftPosition) / 10.0 * inchesPerDegree;
+			double rightMoved = (step.rightPosition - previous.rightPosition) / 10.0 * inchesPerDegree;
+			double turn = (rightMoved - leftMoved) / options.trackWidth;
+			recorded.x += (leftMoved + rightMoved) / 2 * std::cos(recorded.heading + turn / 2);
+			recorded.y += (leftMoved + rightMoved) / 2 * std::sin(recorded.heading + turn / 2);
+			recorded.heading += turn;
+			previous = step;
+		}
+		lastElapsed = elapsed;
+		elapsed = hal::micros() - startTime;
+	}
+	actuators.stop();
+	run.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	run.seconds = ticks * tickSeconds;
+	run.stats = robot.stats();
+	run.actuators = actuators.stats;
+
+	if (trajectory && ticks > 0) {
+		const Pose& end = robot.pose();
+		appendf(run.notes, "  drift from the recording: encoders up to %.0f deg apart, ends %.1f in and %.0f deg from it\n",
+		        maxError, std::hypot(end.x - recorded.x, end.y - recorded.y), headingDegrees(end.heading - recorded.heading));
+	}
+	summarize(out, run, options, tickMs);
+	return true;
+}
+
+/**
+ * A controller trace line, held until the next one.
+ */
+struct TraceLine {
+	uint32_t timeMs;
+	int8_t axes[AXIS_COUNT];
+	uint16_t buttons;
+};
+
+bool loadTrace(const char* path, std::vector<TraceLine>& lines, std::string& error) {
+	FILE* file = std::fopen(path, "r");
+	if (file == nullptr) {
+		error = std::string("can't open: ") + std::strerror(errno);
+		return false;
+	}
+	char text[256];
+	int number = 0;
+	while (std::fgets(text, sizeof(text), file) != nullptr) {
+		number++;
+		char* start = text + std::strspn(text, " \t");
+		if (*start == '#' || *start == '\n' || *start == '\0') {
+			continue;
+		}
+		long values[5];
+		char* end = start;
+		for (long& value : values) {
+			value = std::strtol(end, &end, 10);
+		}
+		long buttons = std::strtol(end, &end, 0);
+		if (*(end + std::strspn(end, " \t\r\n")) != '\0' || values[0] < 0 || (!lines.empty() && values[0] < long(lines.back().timeMs))) {
+			error = "bad line " + std::to_string(number);
+			std::fclose(file);
+			return false;
+		}
+		TraceLine line = {uint32_t(values[0]), {}, uint16_t(buttons)};
+		for (int i = 0; i < AXIS_COUNT; i++) {
+			line.axes[i] = int8_t(std::clamp(values[i + 1], -127L, 127L));
+		}
+		lines.push_back(line);
+	}
+	std::fclose(file);
+	if (lines.empty()) {
+		error = "no input in the trace";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Drives the control code with a controller trace the way opcontrol() runs
+ * it, then keeps going a second past the end so the robot can coast to a stop.
+ */
+bool simulateTrace(const char* path, const Options& options, std::string& out) {
+	std::vector<TraceLine> lines;
+	std::string error;
+	if (!loadTrace(path, lines, error)) {
+		appendf(out, "  error: %s\n", error.c_str());
+		return false;
+	}
+	constexpr uint16_t TICK_MS = 20;
+	uint32_t endMs = lines.back().timeMs + 1000;
+	appendf(out, "  %zu trace lines, %u ticks of %ums\n", lines.size(), unsigned(endMs / TICK_MS), unsigned(TICK_MS));
+
+	hal::mock::reset();
+	RobotModel robot(options);
+	Actuators actuators;
+	InputLayer input;
+	Bindings<DRIVER_BINDINGS> bindings(input);
+	DriveControl drive;
+	input.readOnly(bindings.BUTTONS, drive.AXES);
+	IntakeFilter intakeFilter;
+
+	Run run;
+	size_t next = 0;
+	int modeChanges = 0;
+	auto start = std::chrono::steady_clock::now();
+	while (hal::millis() < endMs) {
+		while (next < lines.size() && lines[next].timeMs <= hal::millis()) {
+			const TraceLine& line = lines[next++];
+			std::copy(line.axes, line.axes + AXIS_COUNT, hal::mock::controllerAxes);
+			hal::mock::controllerButtons = line.buttons;
+		}
+		input.update();
+		uint32_t actions = bindings.evaluate(input);
+		DriveMode mode = drive.mode();
+		DriveCommand command = drive.update(input, actions);
+		modeChanges += drive.mode() != mode;
+		actuators.drive(command.left, command.right, options.deadzone);
+		int intakePower = intakeFilter.apply(command.intake * 127);
+		actuators.intakeOutput.move(intakePower);
+		actuators.rampOutput.move(intakePower);
+		actuators.goalClampOutput.set(command.goalClamp);
+		robot.run(TICK_MS / 1000.0);
+		run.poses.push_back(robot.pose());
+	}
+	run.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	run.seconds = endMs / 1000.0;
+	run.stats = robot.stats();
+	run.actuators = actuators.stats;
+	appendf(run.notes, "  drive mode changed %d times, ended in %s\n", modeChanges, drive.mode() == DRIVE_MODE_TANK ? "tank" : "arcade");
+	summarize(out, run, options, TICK_MS);
+	return true;
+}
+
+void usage() {
+	std::fprintf(stderr,
+		"usage: drive_sim [options] FILE...\n"
+		"  FILE is a replayN.bin, or a controller trace of lines of\n"
+		"  time_ms left_x left_y right_x right_y buttons\n"
+		"options:\n"
+		"  --open             play replays open loop even if they have a trajectory\n"
+		"  --path             print the simulated path once a second\n"
+		"  --deadzone N       drive deadzone, default 10\n"
+		"  --wheel IN         wheel diameter in inches, default 3.25\n"
+		"  --track IN         track width in inches, default 12\n"
+		"  --ratio R          wheel turns per motor turn, default 1\n"
+		"  --rpm N            cartridge free speed, default 600\n"
+		"  --torque NM        cartridge stall torque, default 0.35\n"
+		"  --battery V        battery voltage, default 12.8\n"
+		"  --mass KG          robot mass, default 7\n"
+		"  --friction MU      tyre friction, default 1\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+	Options options;
+	std::vector<const char*> files;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--open") {
+			options.openLoop = true;
+		} else if (arg == "--path") {
+			options.path = true;
+		} else if (arg == "--deadzone" && hasValue) {
+			options.deadzone = std::atoi(argv[++i]);
+		} else if (arg == "--wheel" && hasValue) {
+			options.wheelDiameter = std::atof(argv[++i]);
+		} else if (arg == "--track" && hasValue) {
+			options.trackWidth = std::atof(argv[++i]);
+		} else if (arg == "--ratio" && hasValue) {
+			options.gearRatio = std::atof(argv[++i]);
+		} else if (arg == "--rpm" && hasValue) {
+			options.motorRpm = std::atof(argv[++i]);
+		} else if (arg == "--torque" && hasValue) {
+			options.stallTorque = std::atof(argv[++i]);
+		} else if (arg == "--battery" && hasValue) {
+			options.battery = std::atof(argv[++i]);
+		} else if (arg == "--mass" && hasValue) {
+			options.mass = std::atof(argv[++i]);
+		} else if (arg == "--friction" && hasValue) {
+			options.friction = std::atof(argv[++i]);
+		} else if (arg == "-h" || arg == "--help" || (arg.size() > 1 && arg[0] == '-')) {
+			usage();
+			return 2;
+		} else {
+			files.push_back(argv[i]);
+		}
+	}
+	if (files.empty() || options.wheelDiameter <= 0 || options.trackWidth <= 0 || options.gearRatio <= 0 ||
+	    options.motorRpm <= 0 || options.stallTorque <= 0 || options.mass <= 0 || options.friction < 0) {
+		usage();
+		return 2;
+	}
+
+	int failures = 0;
+	for (const char* file : files) {
+		std::string out;
+		appendf(out, "%s\n", file);
+		bool ok = isReplay(file) ? simulateReplay(file, options, out) : simulateTrace(file, options, out);
+		failures += !ok;
+		std::fputs(out.c_str(), stdout);
+	}
+	return failures == 0 ? 0 : 1;
+}
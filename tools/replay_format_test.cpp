@@ -0,0 +1,278 @@
+// Checks replay_format.cpp against files built here the way the robot writes
+// them, run on a PC.
+//
+//   replay_format_test
+//
+// Covers an encode and decode round trip, including a decoder fed a few bytes
+// at a time the way ReplayReader streams, and the damaged files the robot has
+// to cope with: a trailer cut short by a power loss, a corrupted block in the
+// middle, a file with only its header, and a headerless legacy file. Exits
+// with 1 if anything is wrong.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "replay_format.hpp"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+	if (!ok) {
+		std::printf("  FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+bool same(const Iteration& a, const Iteration& b) {
+	return a.left == b.left && a.right == b.right && a.intake == b.intake && a.goalClamp == b.goalClamp &&
+	       a.leftPosition == b.leftPosition && a.rightPosition == b.rightPosition &&
+	       a.leftVelocity == b.leftVelocity && a.rightVelocity == b.rightVelocity;
+}
+
+// Something like a driver: every channel changes, with stretches of nothing
+std::vector<Iteration> makeIterations(int ticks, bool trajectory) {
+	std::vector<Iteration> iterations;
+	Iteration iteration = {0, 0, 0, false, 0, 0, 0, 0};
+	for (int i = 0; i < ticks; i++) {
+		if ((i / 60) % 4 != 3) {
+			iteration.left = int16_t((i * 7) % 255 - 127);
+			iteration.right = int16_t((i * 3) % 201 - 100);
+			iteration.intake = int16_t((i / 45) % 3 - 1);
+			iteration.goalClamp = (i / 80) % 2;
+			if (trajectory) {
+				iteration.leftPosition += iteration.left * 3;
+				iteration.rightPosition += iteration.right * 3;
+				iteration.leftVelocity = int16_t(iteration.left * 4);
+				iteration.rightVelocity = int16_t(iteration.right * 4);
+			}
+		}
+		iterations.push_back(iteration);
+	}
+	return iterations;
+}
+
+/**
+ * A file written the way ReplayRecorder writes one, and where its blocks start.
+ */
+struct ReplayFile {
+	std::vector<uint8_t> bytes;
+	std::vector<size_t> blocks;
+	std::vector<uint32_t> blockEnds;	// endTick of each block
+};
+
+template <typename T>
+void append(std::vector<uint8_t>& bytes, const T& value) {
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(&value);
+	bytes.insert(bytes.end(), data, data + sizeof(value));
+}
+
+ReplayFile writeReplay(const std::vector<Iteration>& iterations, bool trajectory, uint32_t generation) {
+	ReplayFile file;
+	ReplayEncoder encoder;
+	encoder.reset(20, trajectory, {{1, 2, 3, 0}});
+	ReplayHeader header = encoder.header();
+	append(file.bytes, header);
+	if (header.version == REPLAY_VERSION) {
+		append(file.bytes, encoder.driverInfo());
+	}
+
+	uint8_t encoded[REPLAY_MAX_BLOCK_SIZE];
+	size_t encodedSize = 0;
+	uint32_t lastBlockTick = 0;
+	auto flush = [&]() {
+		file.blocks.push_back(file.bytes.size());
+		file.blockEnds.push_back(encoder.count());
+		append(file.bytes, replayMakeBlock(encoded, encodedSize, encoder.count()));
+		file.bytes.insert(file.bytes.end(), encoded, encoded + encodedSize);
+		encodedSize = 0;
+		lastBlockTick = encoder.count();
+	};
+	for (const Iteration& iteration : iterations) {
+		if (encodedSize + ReplayEncoder::MAX_EVENT_SIZE > sizeof(encoded)) {
+			flush();
+		}
+		encodedSize += encoder.add(iteration, encoded + encodedSize);
+		if (encodedSize > 0 && encoder.count() - lastBlockTick >= 100) {
+			flush();
+		}
+	}
+	if (encodedSize > 0) {
+		flush();
+	}
+	ReplayTrailer trailer = encoder.trailer();
+	append(file.bytes, trailer);
+	if (header.version == REPLAY_VERSION) {
+		append(file.bytes, replayMakeGeneration(trailer, generation));
+	}
+	return file;
+}
+
+// Decodes a whole payload, fed `step` bytes at a time
+std::vector<Iteration> decode(const std::vector<uint8_t>& payload, const ReplayInfo& info, size_t step, bool& verified) {
+	std::vector<Iteration> iterations;
+	ReplayDecoder decoder;
+	decoder.reset(info);
+	const uint8_t* position = payload.data();
+	const uint8_t* available = payload.data();
+	const uint8_t* end = payload.data() + payload.size();
+	Iteration iteration;
+	while (true) {
+		DecodeResult result = decoder.next(iteration, position, available);
+		if (result == DECODE_OK) {
+			iterations.push_back(iteration);
+		} else if (result == DECODE_NEED_BYTES && available < end) {
+			available = std::min(available + step, end);
+		} else {
+			break;
+		}
+	}
+	verified = decoder.verified();
+	return iterations;
+}
+
+bool matchesPrefix(const std::vector<Iteration>& decoded, const std::vector<Iteration>& original) {
+	if (decoded.size() > original.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < decoded.size(); i++) {
+		if (!same(decoded[i], original[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool fileGeneration(const std::vector<uint8_t>& bytes, uint32_t& generation) {
+	size_t tailSize = std::min(bytes.size(), REPLAY_END_SIZE);
+	return replayFileGeneration(bytes.data(), std::min(bytes.size(), sizeof(ReplayHeader)),
+	                            bytes.data() + bytes.size() - tailSize, tailSize, generation);
+}
+
+void roundTrip() {
+	std::printf("Round trip\n");
+	for (bool trajectory : {true, false}) {
+		std::vector<Iteration> iterations = makeIterations(3000, trajectory);
+		ReplayFile file = writeReplay(iterations, trajectory, 7);
+		std::vector<uint8_t> payload;
+		ReplayInfo info;
+		bool recovered;
+		check(replayParse(file.bytes.data(), file.bytes.size(), payload, info, recovered), "parses");
+		check(!recovered, "is complete");
+		check(info.count == iterations.size(), "keeps the count");
+		check(info.channels == (trajectory ? 8 : 4), "keeps the channels");
+		check(info.generation == (trajectory ? 7u : 0u), "keeps the generation");
+		check(!trajectory || info.driver.curves[1] == 2, "keeps the driver info");
+		for (size_t step : {payload.size(), size_t(1), size_t(7)}) {
+			bool verified;
+			std::vector<Iteration> decoded = decode(payload, info, step, verified);
+			check(decoded.size() == iterations.size() && matchesPrefix(decoded, iterations), "decodes to what was encoded");
+			check(verified, "matches its CRC");
+		}
+		std::printf("  %zu ticks %s trajectory in %zu bytes, %zu blocks\n", iterations.size(), trajectory ? "with" : "without",
+		            file.bytes.size(), file.blocks.size());
+	}
+	uint32_t generation;
+	ReplayFile file = writeReplay(makeIterations(100, true), true, 41);
+	check(fileGeneration(file.bytes, generation) && generation == 41, "generation reads from the ends of the file");
+	ReplayTrailer trailer;
+	check(replayReadTrailer(file.bytes.data(), sizeof(ReplayHeader), file.bytes.data() + file.bytes.size() - REPLAY_END_SIZE,
+	                        REPLAY_END_SIZE, trailer, generation) && trailer.count == 100, "trailer reads from the ends of the file");
+}
+
+void truncatedTrailer() {
+	std::printf("Truncated trailer\n");
+	std::vector<Iteration> iterations = makeIterations(1000, true);
+	ReplayFile file = writeReplay(iterations, true, 3);
+	for (size_t cut : {size_t(4), sizeof(ReplayGeneration), REPLAY_END_SIZE - 2, REPLAY_END_SIZE}) {
+		std::vector<uint8_t> bytes(file.bytes.begin(), file.bytes.end() - cut);
+		std::vector<uint8_t> payload;
+		ReplayInfo info;
+		bool recovered;
+		bool parsed = replayParse(bytes.data(), bytes.size(), payload, info, recovered);
+		bool verified;
+		std::vector<Iteration> decoded = decode(payload, info, payload.size(), verified);
+		uint32_t generation;
+		check(parsed && recovered, "plays what was recovered");
+		check(info.count == file.blockEnds.back(), "keeps every whole block");
+		check(matchesPrefix(decoded, iterations) && decoded.size() == info.count, "recovered part decodes");
+		check(!fileGeneration(bytes, generation), "never counts as a finished save");
+	}
+}
+
+void corruptedBlock() {
+	std::printf("Corrupted middle block\n");
+	std::vector<Iteration> iterations = makeIterations(1000, true);
+	ReplayFile file = writeReplay(iterations, true, 3);
+	size_t middle = file.blocks.size() / 2;
+	check(middle > 0, "has blocks either side of the middle");
+	std::vector<uint8_t> bytes = file.bytes;
+	bytes[file.blocks[middle] + sizeof(ReplayBlockHeader) + 1] ^= 0x10;
+	std::vector<uint8_t> payload;
+	ReplayInfo info;
+	bool recovered;
+	bool parsed = replayParse(bytes.data(), bytes.size(), payload, info, recovered);
+	bool verified;
+	std::vector<Iteration> decoded = decode(payload, info, payload.size(), verified);
+	check(parsed && recovered, "plays what was recovered");
+	check(info.count == file.blockEnds[middle - 1], "stops before the bad block");
+	check(matchesPrefix(decoded, iterations) && decoded.size() == info.count, "recovered part decodes");
+	check(info.generation == 0, "has no generation");
+}
+
+void headerOnly() {
+	std::printf("Header only\n");
+	for (bool trajectory : {true, false}) {
+		ReplayEncoder encoder;
+		encoder.reset(20, trajectory);
+		std::vector<uint8_t> bytes;
+		append(bytes, encoder.header());
+		if (trajectory) {
+			append(bytes, encoder.driverInfo());
+		}
+		std::vector<uint8_t> payload;
+		ReplayInfo info;
+		bool recovered;
+		check(!replayParse(bytes.data(), bytes.size(), payload, info, recovered), "nothing to play");
+		uint32_t generation;
+		check(fileGeneration(bytes, generation) != trajectory, "only a version 6 header is an unfinished save");
+	}
+}
+
+void legacy() {
+	std::printf("Headerless legacy file\n");
+	std::vector<uint8_t> bytes;
+	std::vector<Iteration> iterations;
+	for (uint32_t i = 0; i < REPLAY_LEGACY_COUNT; i++) {
+		RawIteration raw = {int16_t(int(i % 255) - 127), int16_t(-int(i % 100)), int16_t(i / 100 % 3), (i / 50) % 2 == 1};
+		append(bytes, raw);
+		iterations.push_back(replayFromRaw(raw));
+	}
+	check(bytes.size() == 6000, "is 6000 bytes");
+	check(replayDetectFormat(bytes.data(), bytes.size(), bytes.size()).format == REPLAY_FORMAT_LEGACY, "detected as legacy");
+	std::vector<uint8_t> payload;
+	ReplayInfo info;
+	bool recovered;
+	check(replayParse(bytes.data(), bytes.size(), payload, info, recovered) && !recovered, "parses");
+	check(info.count == REPLAY_LEGACY_COUNT && info.tickMs == 20 && info.channels == 4, "15 seconds of 20ms ticks, no trajectory");
+	bool verified;
+	std::vector<Iteration> decoded = decode(payload, info, payload.size(), verified);
+	check(decoded.size() == iterations.size() && matchesPrefix(decoded, iterations) && verified, "plays the raw iterations");
+	uint32_t generation;
+	check(fileGeneration(bytes, generation) && generation == 0, "counts as generation 0");
+}
+
+}  // namespace
+
+int main() {
+	roundTrip();
+	truncatedTrailer();
+	corruptedBlock();
+	headerOnly();
+	legacy();
+	std::printf(failures == 0 ? "Replay format test passed\n" : "Replay format test FAILED\n");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,417 @@
+// Host tool for looking at replay files pulled off the SD card.
+//
+//   replay_tool [options] FILE...     Prints a summary of each replay
+//   replay_tool diff [options] A B    Compares two replays tick by tick
+//
+// Files are parsed with the same replay_format.cpp the robot uses, so every
+// format the robot can play is read here the same way.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "drive_curves.hpp"
+#include "replay_format.hpp"
+
+namespace {
+
+struct Options {
+	int deadzone = 10;				// Same as driveDeadzone in main.cpp
+	double wheelDiameter = 3.25;	// Inches
+	double trackWidth = 12.0;		// Inches between the left and right wheels
+	double gearRatio = 1.0;			// Wheel turns per motor turn
+	double maxSpeed = 60.0;			// Inches per second at full stick, for replays with no trajectory
+	bool path = false;				// Print the estimated path, not just where it ends
+	int threads = 0;				// 0 to use every core
+};
+
+/**
+ * A replay file mapped into memory and decoded.
+ */
+struct Replay {
+	ReplayInfo info;
+	bool recovered = false;
+	std::vector<Iteration> iterations;
+	std::string error;
+};
+
+/**
+ * Maps a file read only, so thousands of files can be parsed without copying
+ * them through read buffers.
+ */
+class MappedFile {
+	public:
+	explicit MappedFile(const char* path) {
+		int fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			return;
+		}
+		struct stat status;
+		if (fstat(fd, &status) == 0) {
+			if (status.st_size == 0) {
+				opened = true;		// Nothing to map, parses as an invalid replay
+			} else {
+				void* mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (mapped != MAP_FAILED) {
+					data = static_cast<const uint8_t*>(mapped);
+					size = status.st_size;
+					opened = true;
+				}
+			}
+		}
+		close(fd);
+	}
+	~MappedFile() {
+		if (data != nullptr) {
+			munmap(const_cast<uint8_t*>(data), size);
+		}
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool opened = false;
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+};
+
+Replay loadReplay(const char* path) {
+	Replay replay;
+	MappedFile file(path);
+	if (!file.opened) {
+		replay.error = std::string("can't open: ") + std::strerror(errno);
+		return replay;
+	}
+	std::vector<uint8_t> payload;
+	if (!replayParse(file.data, file.size, payload, replay.info, replay.recovered)) {
+		replay.error = "not a valid replay";
+		return replay;
+	}
+	replay.iterations.reserve(replay.info.count);
+	ReplayDecoder decoder;
+	decoder.reset(replay.info);
+	const uint8_t* position = payload.data();
+	Iteration iteration;
+	while (decoder.next(iteration, position, payload.data() + payload.size()) == DECODE_OK) {
+		replay.iterations.push_back(iteration);
+	}
+	return replay;
+}
+
+void appendf(std::string& out, const char* format, ...) {
+	char line[256];
+	va_list args;
+	va_start(args, format);
+	std::vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	out += line;
+}
+
+/**
+ * A named channel of an iteration, so statistics and diffs can loop over them.
+ */
+struct Channel {
+	const char* name;
+	double (*get)(const Iteration&);
+	bool trajectory;	// Only recorded in replays with a trajectory
+};
+
+const Channel CHANNELS[] = {
+	{"left", [](const Iteration& it) { return double(it.left); }, false},
+	{"right", [](const Iteration& it) { return double(it.right); }, false},
+	{"intake", [](const Iteration& it) { return double(it.intake); }, false},
+	{"clamp", [](const Iteration& it) { return double(it.goalClamp); }, false},
+	{"left pos", [](const Iteration& it) { return it.leftPosition / 10.0; }, true},
+	{"right pos", [](const Iteration& it) { return it.rightPosition / 10.0; }, true},
+	{"left vel", [](const Iteration& it) { return double(it.leftVelocity); }, true},
+	{"right vel", [](const Iteration& it) { return double(it.rightVelocity); }, true},
+};
+
+bool hasTrajectory(const Replay& replay) {
+	return replay.info.channels == 8;
+}
+
+struct Pose {
+	double x = 0;			// Inches
+	double y = 0;
+	double heading = 0;		// Radians, 0 along +x
+};
+
+double headingDegrees(const Pose& pose) {
+	return std::remainder(pose.heading, 2 * M_PI) * 180 / M_PI;
+}
+
+/**
+ * Dead reckons where the robot went. Replays with a trajectory use the
+ * recorded encoder positions; older ones assume the drive followed the stick
+ * at maxSpeed, which is only a rough idea.
+ */
+std::vector<Pose> estimatePath(const Replay& replay, const Options& options) {
+	std::vector<Pose> path;
+	path.reserve(replay.iterations.size());
+	double inchesPerDegree = M_PI * options.wheelDiameter * options.gearRatio / 360.0;
+	double tickSeconds = replay.info.tickMs / 1000.0;
+	Pose pose;
+	Iteration previous = replay.iterations.empty() ? Iteration{} : replay.iterations[0];
+	for (const Iteration& iteration : replay.iterations) {
+		double left, right;
+		if (hasTrajectory(replay)) {
+			left = (iteration.leftPosition - previous.leftPosition) / 10.0 * inchesPerDegree;
+			right = (iteration.rightPosition - previous.rightPosition) / 10.0 * inchesPerDegree;
+		} else {
+			left = std::abs(iteration.left) > options.deadzone ? iteration.left / 127.0 * options.maxSpeed * tickSeconds : 0;
+			right = std::abs(iteration.right) > options.deadzone ? iteration.right / 127.0 * options.maxSpeed * tickSeconds : 0;
+		}
+		double distance = (left + right) / 2;
+		double turn = (right - left) / options.trackWidth;
+		// Moves along the arc's chord, at the heading halfway through the turn
+		pose.x += distance * std::cos(pose.heading + turn / 2);
+		pose.y += distance * std::sin(pose.heading + turn / 2);
+		pose.heading += turn;
+		path.push_back(pose);
+		previous = iteration;
+	}
+	return path;
+}
+
+std::string summarize(const char* path, const Replay& replay, const Options& options) {
+	std::string out;
+	appendf(out, "%s\n", path);
+	if (!replay.error.empty()) {
+		appendf(out, "  error: %s\n", replay.error.c_str());
+		return out;
+	}
+	const std::vector<Iteration>& iterations = replay.iterations;
+	double tickSeconds = replay.info.tickMs / 1000.0;
+	appendf(out, "  %zu ticks of %ums, %.2fs, %s%s\n", iterations.size(), unsigned(replay.info.tickMs),
+	        iterations.size() * tickSeconds, hasTrajectory(replay) ? "with trajectory" : "commands only",
+	        replay.recovered ? ", recovered from a damaged file" : "");
+	if (replay.info.generation > 0) {
+		appendf(out, "  save generation %u\n", unsigned(replay.info.generation));
+	}
+	const uint8_t* curves = replay.info.driver.curves;
+	appendf(out, "  stick curves: left X %s, left Y %s, right X %s, right Y %s\n", driveCurveName(curves[0]),
+	        driveCurveName(curves[1]), driveCurveName(curves[2]), driveCurveName(curves[3]));
+
+	appendf(out, "  %-10s %9s %9s %9s %9s\n", "channel", "min", "max", "mean", "stddev");
+	for (const Channel& channel : CHANNELS) {
+		if (channel.trajectory && !hasTrajectory(replay)) {
+			continue;
+		}
+		double low = INFINITY, high = -INFINITY, sum = 0, squares = 0;
+		for (const Iteration& iteration : iterations) {
+			double value = channel.get(iteration);
+			low = std::min(low, value);
+			high = std::max(high, value);
+			sum += value;
+			squares += value * value;
+		}
+		double mean = sum / iterations.size();
+		double deviation = std::sqrt(std::max(0.0, squares / iterations.size() - mean * mean));
+		appendf(out, "  %-10s %9.1f %9.1f %9.1f %9.1f\n", channel.name, low, high, mean, deviation);
+	}
+
+	size_t leftIdle = 0, rightIdle = 0, bothIdle = 0;
+	for (const Iteration& iteration : iterations) {
+		bool left = std::abs(iteration.left) <= options.deadzone;
+		bool right = std::abs(iteration.right) <= options.deadzone;
+		leftIdle += left;
+		rightIdle += right;
+		bothIdle += left && right;
+	}
+	appendf(out, "  deadzone +-%d: left %.1f%%, right %.1f%%, both %.1f%%\n", options.deadzone,
+	        100.0 * leftIdle / iterations.size(), 100.0 * rightIdle / iterations.size(), 100.0 * bothIdle / iterations.size());
+
+	out += "  clamp toggles:";
+	bool clamp = false;
+	int toggles = 0;
+	for (size_t i = 0; i < iterations.size(); i++) {
+		if (iterations[i].goalClamp != clamp) {
+			clamp = iterations[i].goalClamp;
+			appendf(out, " %.2fs%s", i * tickSeconds, clamp ? "+" : "-");
+			toggles++;
+		}
+	}
+	out += toggles == 0 ? " none\n" : "\n";
+
+	std::vector<Pose> poses = estimatePath(replay, options);
+	double travelled = 0;
+	for (size_t i = 1; i < poses.size(); i++) {
+		travelled += std::hypot(poses[i].x - poses[i - 1].x, poses[i].y - poses[i - 1].y);
+	}
+	const Pose& end = poses.back();
+	appendf(out, "  path%s: ends at (%.1f, %.1f) in, heading %.0f deg, %.1f in travelled\n",
+	        hasTrajectory(replay) ? "" : " (from commands)", end.x, end.y, headingDegrees(end), travelled);
+	if (options.path) {
+		// One point a second is plenty to sketch the path
+		size_t step = std::max<size_t>(1, 1000 / std::max<uint16_t>(1, replay.info.tickMs));
+		for (size_t i = 0; i < poses.size(); i += step) {
+			appendf(out, "    %6.2fs %8.1f %8.1f %6.0f\n", i * tickSeconds, poses[i].x, poses[i].y, headingDegrees(poses[i]));
+		}
+	}
+	return out;
+}
+
+std::string diff(const char* pathA, const Replay& a, const char* pathB, const Replay& b, const Options& options) {
+	std::string out;
+	appendf(out, "--- %s\n+++ %s\n", pathA, pathB);
+	if (!a.error.empty() || !b.error.empty()) {
+		appendf(out, "  error: %s\n", !a.error.empty() ? a.error.c_str() : b.error.c_str());
+		return out;
+	}
+	if (a.info.tickMs != b.info.tickMs) {
+		appendf(out, "  tick length differs: %ums vs %ums, compared tick by tick anyway\n", unsigned(a.info.tickMs), unsigned(b.info.tickMs));
+	}
+	appendf(out, "  ticks: %zu vs %zu\n", a.iterations.size(), b.iterations.size());
+
+	size_t common = std::min(a.iterations.size(), b.iterations.size());
+	bool trajectory = hasTrajectory(a) && hasTrajectory(b);
+	double tickSeconds = a.info.tickMs / 1000.0;
+	appendf(out, "  %-10s %9s %9s %12s\n", "channel", "max diff", "mean diff", "first diff");
+	for (const Channel& channel : CHANNELS) {
+		if (channel.trajectory && !trajectory) {
+			continue;
+		}
+		double largest = 0, sum = 0;
+		size_t first = common;
+		for (size_t i = 0; i < common; i++) {
+			double difference = std::abs(channel.get(a.iterations[i]) - channel.get(b.iterations[i]));
+			largest = std::max(largest, difference);
+			sum += difference;
+			if (difference > 0 && first == common) {
+				first = i;
+			}
+		}
+		if (first == common) {
+			appendf(out, "  %-10s %9s %9s %12s\n", channel.name, "-", "-", "same");
+		} else {
+			appendf(out, "  %-10s %9.1f %9.2f %11.2fs\n", channel.name, largest, sum / common, first * tickSeconds);
+		}
+	}
+
+	std::vector<Pose> posesA = estimatePath(a, options);
+	std::vector<Pose> posesB = estimatePath(b, options);
+	if (common > 0) {
+		double largest = 0;
+		for (size_t i = 0; i < common; i++) {
+			largest = std::max(largest, std::hypot(posesA[i].x - posesB[i].x, posesA[i].y - posesB[i].y));
+		}
+		appendf(out, "  paths: end %.1f in apart, at most %.1f in apart\n",
+		        std::hypot(posesA.back().x - posesB.back().x, posesA.back().y - posesB.back().y), largest);
+	}
+	return out;
+}
+
+/**
+ * Runs job(i) for every i below count across a pool of threads.
+ */
+template <typename Job>
+void parallelFor(size_t count, int threads, Job job) {
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i = next++; i < count; i = next++) {
+			job(i);
+		}
+	};
+	std::vector<std::thread> pool;
+	size_t poolSize = std::min<size_t>(threads, count);
+	for (size_t i = 1; i < poolSize; i++) {
+		pool.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : pool) {
+		thread.join();
+	}
+}
+
+void usage() {
+	std::fprintf(stderr,
+		"usage: replay_tool [options] FILE...\n"
+		"       replay_tool diff [options] A B\n"
+		"options:\n"
+		"  -j N               threads to parse with, default every core\n"
+		"  --deadzone N       stick deadzone, default 10\n"
+		"  --path             print the estimated path once a second\n"
+		"  --wheel IN         wheel diameter in inches, default 3.25\n"
+		"  --track IN         track width in inches, default 12\n"
+		"  --ratio R          wheel turns per motor turn, default 1\n"
+		"  --max-speed IN/S   speed at full stick for replays with no trajectory, default 60\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+	Options options;
+	std::vector<const char*> files;
+	bool diffMode = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (i == 1 && arg == "diff") {
+			diffMode = true;
+		} else if (arg == "-j" && hasValue) {
+			options.threads = std::atoi(argv[++i]);
+		} else if (arg == "--deadzone" && hasValue) {
+			options.deadzone = std::atoi(argv[++i]);
+		} else if (arg == "--path") {
+			options.path = true;
+		} else if (arg == "--wheel" && hasValue) {
+			options.wheelDiameter = std::atof(argv[++i]);
+		} else if (arg == "--track" && hasValue) {
+			options.trackWidth = std::atof(argv[++i]);
+		} else if (arg == "--ratio" && hasValue) {
+			options.gearRatio = std::atof(argv[++i]);
+		} else if (arg == "--max-speed" && hasValue) {
+			options.maxSpeed = std::atof(argv[++i]);
+		} else if (arg == "-h" || arg == "--help" || (arg.size() > 1 && arg[0] == '-')) {
+			usage();
+			return 2;
+		} else {
+			files.push_back(argv[i]);
+		}
+	}
+	if (files.empty() || (diffMode && files.size() != 2)) {
+		usage();
+		return 2;
+	}
+	if (options.threads <= 0) {
+		options.threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	if (diffMode) {
+		Replay replays[2];
+		parallelFor(2, options.threads, [&](size_t i) { replays[i] = loadReplay(files[i]); });
+		std::fputs(diff(files[0], replays[0], files[1], replays[1], options).c_str(), stdout);
+		return replays[0].error.empty() && replays[1].error.empty() ? 0 : 1;
+	}
+
+	// Each file is parsed and summarized on the pool, then printed in the order given
+	std::vector<std::string> reports(files.size());
+	std::atomic<int> failures(0);
+	parallelFor(files.size(), options.threads, [&](size_t i) {
+		Replay replay = loadReplay(files[i]);
+		if (!replay.error.empty()) {
+			failures++;
+		}
+		reports[i] = summarize(files[i], replay, options);
+	});
+	for (const std::string& report : reports) {
+		std::fputs(report.c_str(), stdout);
+	}
+	if (files.size() > 1) {
+		std::printf("%zu files, %d not valid replays\n", files.size(), failures.load());
+	}
+	return failures == 0 ? 0 : 1;
+}
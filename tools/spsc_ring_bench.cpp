@@ -0,0 +1,233 @@
+// Stress test and throughput benchmark for SpscRing, run on a PC.
+//
+//   spsc_ring_bench [seconds per run]
+//
+// The stress test runs a producer and a consumer thread, with the consumer
+// switching between single pops, batched copies and in place reads. In lossy
+// runs the producer never waits and the consumer sometimes stalls, so the ring
+// overruns constantly and every dropped item must be counted. In lossless runs
+// the producer retries a full ring, so every item must arrive. Every item
+// carries its sequence number and a payload derived from it, so a lost,
+// repeated, reordered or torn item is caught. Exits with 1 if anything is
+// wrong.
+//
+// The benchmark then measures items per second through the ring for each way
+// of reading, with both sides yielding rather than spinning so the numbers
+// mean something on a single core too.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+#include "spsc_ring.hpp"
+
+namespace {
+
+struct Item {
+	uint32_t sequence;
+	uint32_t payload[5];	// About the size of a DriverSample
+};
+
+Item makeItem(uint32_t sequence) {
+	Item item;
+	item.sequence = sequence;
+	for (int i = 0; i < 5; i++) {
+		item.payload[i] = sequence * 2654435761u + i;
+	}
+	return item;
+}
+
+bool itemValid(const Item& item) {
+	for (int i = 0; i < 5; i++) {
+		if (item.payload[i] != item.sequence * 2654435761u + i) {
+			return false;
+		}
+	}
+	return true;
+}
+
+enum ReadMode {
+	READ_SINGLE,
+	READ_BATCH,
+	READ_FRONT,
+	READ_MIXED
+};
+
+const char* readModeName(ReadMode mode) {
+	switch (mode) {
+		case READ_SINGLE: return "pop";
+		case READ_BATCH: return "pop batch";
+		case READ_FRONT: return "front/consume";
+		case READ_MIXED: return "mixed";
+	}
+	return "?";
+}
+
+/**
+ * Checks what the consumer reads. Items may be missing where the producer
+ * overran, but everything else has to arrive whole and in order.
+ */
+struct Checker {
+	uint32_t expected = 0;
+	uint64_t received = 0;
+	uint64_t skipped = 0;
+	uint64_t errors = 0;
+
+	void check(const Item& item) {
+		if (!itemValid(item) || item.sequence < expected) {
+			errors++;
+			return;
+		}
+		skipped += item.sequence - expected;
+		expected = item.sequence + 1;
+		received++;
+	}
+};
+
+struct RunResult {
+	uint64_t produced;
+	uint64_t received;
+	uint64_t skipped;
+	uint64_t overruns;
+	uint64_t errors;
+	double seconds;
+};
+
+/**
+ * Runs one producer and one consumer through a fresh ring.
+ *
+ * \param retry
+ *        True for the producer to retry a full ring rather than drop the item
+ * \param stallEvery
+ *        The consumer sleeps briefly after this many reads to force
+ *        overruns, 0 never
+ */
+template <size_t N>
+RunResult run(ReadMode mode, double seconds, bool retry, uint32_t stallEvery) {
+	auto owner = std::make_unique<SpscRing<Item, N>>();		// Too big for the stack at larger sizes
+	SpscRing<Item, N>& ring = *owner;
+	std::atomic<bool> stop{false};
+	std::atomic<uint64_t> produced{0};
+
+	std::thread producer([&] {
+		uint32_t sequence = 0;
+		while (!stop.load(std::memory_order_relaxed)) {
+			// A dropped item still uses up its sequence number, so the consumer sees the gap
+			if (ring.push(makeItem(sequence))) {
+				sequence++;
+			} else if (retry) {
+				std::this_thread::yield();
+			} else {
+				sequence++;
+			}
+		}
+		produced.store(sequence);
+	});
+
+	Checker checker;
+	Item batch[16];
+	uint32_t reads = 0;
+	auto start = std::chrono::steady_clock::now();
+	auto end = start + std::chrono::duration<double>(seconds);
+	int turn = 0;
+	while (std::chrono::steady_clock::now() < end) {
+		for (int repeat = 0; repeat < 256; repeat++) {
+			ReadMode current = mode == READ_MIXED ? ReadMode(turn++ % 3) : mode;
+			size_t count = 0;
+			if (current == READ_SINGLE) {
+				Item item;
+				if (ring.pop(item)) {
+					checker.check(item);
+					count = 1;
+				}
+			} else if (current == READ_BATCH) {
+				count = ring.pop(batch, 16);
+				for (size_t i = 0; i < count; i++) {
+					checker.check(batch[i]);
+				}
+			} else {
+				const Item* items;
+				count = ring.front(items);
+				for (size_t i = 0; i < count; i++) {
+					checker.check(items[i]);
+				}
+				ring.consume(count);
+			}
+			if (count == 0 && retry) {
+				std::this_thread::yield();
+			}
+			if (stallEvery != 0 && ++reads % stallEvery == 0) {
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		}
+	}
+	stop.store(true);
+	producer.join();
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Whatever is left in the ring
+	Item item;
+	while (ring.pop(item)) {
+		checker.check(item);
+	}
+	// Pushes dropped after the last item read are overruns too, but leave no gap behind them
+	uint64_t trailing = produced.load() - checker.expected;
+	return {produced.load(), checker.received, checker.skipped + trailing, ring.overruns(), checker.errors, elapsed};
+}
+
+bool stress(ReadMode mode, double seconds, bool retry) {
+	bool ok = true;
+	for (int size : {8, 128}) {
+		uint32_t stallEvery = retry ? 0 : 64;
+		RunResult result = size == 8 ? run<8>(mode, seconds, retry, stallEvery) : run<128>(mode, seconds, retry, stallEvery);
+		bool passed;
+		if (retry) {
+			passed = result.errors == 0 && result.skipped == 0 && result.received == result.produced;
+		} else {
+			passed = result.errors == 0 && result.skipped == result.overruns && result.received + result.overruns == result.produced;
+		}
+		std::printf("stress %-13s ring %3d %-8s: %llu produced, %llu received, %llu %s, %llu bad\n",
+		            readModeName(mode), size, retry ? "lossless" : "lossy",
+		            (unsigned long long)result.produced, (unsigned long long)result.received,
+		            (unsigned long long)result.overruns, retry ? "full retries" : "overruns",
+		            (unsigned long long)result.errors);
+		if (!passed) {
+			std::printf("  FAILED: %llu items missing or not counted\n",
+			            (unsigned long long)(result.produced - result.received));
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+void benchmark(ReadMode mode, double seconds) {
+	RunResult result = run<128>(mode, seconds, true, 0);
+	std::printf("bench  %-13s ring 128: %.1fM items/s, %.0fns per item\n",
+	            readModeName(mode), result.received / result.seconds / 1e6,
+	            result.received != 0 ? result.seconds * 1e9 / result.received : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+	double seconds = argc > 1 ? std::atof(argv[1]) : 0.5;
+	if (seconds <= 0 || seconds > 5) {
+		// Longer lossy runs could wrap the 32 bit sequence numbers
+		std::fprintf(stderr, "usage: spsc_ring_bench [seconds per run, up to 5]\n");
+		return 2;
+	}
+
+	bool ok = true;
+	for (ReadMode mode : {READ_SINGLE, READ_BATCH, READ_FRONT, READ_MIXED}) {
+		ok = stress(mode, seconds, false) && ok;
+		ok = stress(mode, seconds, true) && ok;
+	}
+	for (ReadMode mode : {READ_SINGLE, READ_BATCH, READ_FRONT}) {
+		benchmark(mode, seconds);
+	}
+	std::printf(ok ? "All stress runs passed\n" : "Stress test FAILED\n");
+	return ok ? 0 : 1;
+}